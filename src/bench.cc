@@ -0,0 +1,360 @@
+// launch benchmarks against a local fixture. the launcher is built in whole,
+// without its main, and pointed at a server on loopback through the mirror
+// settings, so nothing here goes out to the network. the server is this same
+// binary in another process, or it would show up in every number we take,
+// and so is every phase, so none of them starts out with what the one before
+// left in memory.
+//
+// with AMETRINE_BENCH_STRACE set, phases run under strace -c, which slows
+// them down but also counts the stat, open and mkdir calls
+#include "main.cc"
+
+#include <sys/resource.h>
+
+#include <cstring>
+
+const int BENCH_OBJECTS = 4000;
+const int BENCH_LIBRARIES = 40;
+const qint64 BENCH_CLIENT_SIZE = 24 * 1024 * 1024;
+
+// plain http/1.1 with keep-alive and single ranges, which is everything the
+// scheduler asks for
+class FixtureServer : QTcpServer {
+public:
+  FixtureServer();
+  QString url(const QString &path) const;
+  void serve(const QString &path, const QByteArray &body);
+
+private:
+  void respond(QTcpSocket *socket, const QByteArray &head);
+
+  QHash<QString, QByteArray> files;
+};
+
+FixtureServer::FixtureServer() {
+  listen(QHostAddress::LocalHost);
+  connect(this, &QTcpServer::newConnection, this, [this]() {
+    while (auto socket = nextPendingConnection()) {
+      auto buffer = QSharedPointer<QByteArray>::create();
+      connect(socket, &QTcpSocket::readyRead, this, [=]() {
+        *buffer += socket->readAll();
+        int end;
+        while ((end = buffer->indexOf("\r\n\r\n")) >= 0) {
+          respond(socket, buffer->left(end));
+          buffer->remove(0, end + 4);
+        }
+      });
+      connect(socket, &QTcpSocket::disconnected, socket,
+              &QObject::deleteLater);
+    }
+  });
+}
+
+QString FixtureServer::url(const QString &path) const {
+  return QString("http://127.0.0.1:%1/%2").arg(serverPort()).arg(path);
+}
+
+void FixtureServer::serve(const QString &path, const QByteArray &body) {
+  files["/" + path] = body;
+}
+
+void FixtureServer::respond(QTcpSocket *socket, const QByteArray &head) {
+  auto lines = head.split('\n');
+  auto path = QString::fromLatin1(lines.value(0).split(' ').value(1));
+  if (!files.contains(path)) {
+    socket->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+    return;
+  }
+
+  auto body = files[path];
+  QByteArray status = "200 OK", extra;
+  for (auto line : lines) {
+    if (!line.toLower().startsWith("range: bytes="))
+      continue;
+
+    auto range = line.mid(13).trimmed().split('-');
+    auto start = range.value(0).toLongLong();
+    auto end = range.value(1).isEmpty() ? body.size() - 1
+                                        : range.value(1).toLongLong();
+    extra = QString("Content-Range: bytes %1-%2/%3\r\n")
+                .arg(start)
+                .arg(end)
+                .arg(body.size())
+                .toLatin1();
+    body = body.mid(start, end - start + 1);
+    status = "206 Partial Content";
+  }
+
+  socket->write("HTTP/1.1 " + status + "\r\nContent-Length: " +
+                QByteArray::number(body.size()) + "\r\n" + extra + "\r\n");
+  socket->write(body);
+}
+
+QByteArray randomBytes(QRandomGenerator &random, qint64 size) {
+  QByteArray data(size, Qt::Uninitialized);
+  random.fillRange(reinterpret_cast<quint32 *>(data.data()), size / 4);
+  return data;
+}
+
+QJsonObject artifact(FixtureServer &server, const QString &path,
+                     const QByteArray &data) {
+  server.serve(path, data);
+  auto sha1 = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+  return {{"path", path},
+          {"url", server.url(path)},
+          {"sha1", QString::fromLatin1(sha1.toHex())},
+          {"size", data.size()}};
+}
+
+// shaped like a real release, with a fixed seed so every run sees the same
+void populate(FixtureServer &server) {
+  QRandomGenerator random(1);
+
+  QJsonObject objects;
+  for (int i = 0; i < BENCH_OBJECTS; i++) {
+    auto data = randomBytes(random, random.bounded(256, 64 * 1024) & ~3);
+    auto sha1 = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+    auto hash = QString::fromLatin1(sha1.toHex());
+    server.serve("resources/" + hash.left(2) + "/" + hash, data);
+
+    auto kind = i % 3 == 0 ? "sounds" : i % 3 == 1 ? "textures" : "lang";
+    objects[QString("minecraft/%1/%2").arg(kind).arg(i)] =
+        QJsonObject{{"hash", hash}, {"size", data.size()}};
+  }
+  auto index = QJsonDocument(QJsonObject{{"objects", objects}}).toJson();
+
+  QJsonArray libraries;
+  for (int i = 0; i < BENCH_LIBRARIES; i++) {
+    auto path = QString("bench/lib%1/1.0/lib%1-1.0.jar").arg(i);
+    auto data = randomBytes(random, random.bounded(16, 2048) * 1024);
+    auto lib = artifact(server, "libraries/" + path, data);
+    lib["path"] = path;
+    libraries << QJsonObject{{"name", QString("bench:lib%1:1.0").arg(i)},
+                             {"downloads", QJsonObject{{"artifact", lib}}}};
+  }
+
+  auto client = artifact(server, "client.jar",
+                         randomBytes(random, BENCH_CLIENT_SIZE));
+  auto assetIndex = artifact(server, "indexes/bench.json", index);
+  QJsonObject version{
+      {"id", "bench"},
+      {"type", "release"},
+      {"mainClass", "bench.Main"},
+      {"assets", "bench"},
+      {"assetIndex", assetIndex},
+      {"downloads", QJsonObject{{"client", client}}},
+      {"javaVersion",
+       QJsonObject{{"component", "bench"}, {"majorVersion", 17}}},
+      {"libraries", libraries},
+  };
+  auto versionInfo =
+      artifact(server, "bench.json", QJsonDocument(version).toJson());
+
+  auto manifest = QJsonObject{
+      {"latest", QJsonObject{{"release", "bench"}, {"snapshot", "bench"}}},
+      {"versions", QJsonArray{QJsonObject{{"id", "bench"},
+                                          {"url", versionInfo["url"]},
+                                          {"sha1", versionInfo["sha1"]}}}}};
+  server.serve("manifest.json", QJsonDocument(manifest).toJson());
+  // no runtimes for anything, the game is never started anyway
+  server.serve("runtimes.json", "{}");
+}
+
+// read and write calls so far, not the rest. only linux keeps count of them
+qint64 readWriteCalls() {
+  QFile io("/proc/self/io");
+  if (!io.open(QIODevice::ReadOnly))
+    return -1;
+
+  qint64 count = 0;
+  for (auto line : io.readAll().split('\n'))
+    if (line.startsWith("syscr:") || line.startsWith("syscw:"))
+      count += line.mid(6).trimmed().toLongLong();
+  return count;
+}
+
+// each phase gets its own peak. only linux can reset it, elsewhere it's the
+// peak of the whole run so far
+void resetPeakRss() {
+  QFile refs("/proc/self/clear_refs");
+  if (refs.open(QIODevice::WriteOnly))
+    refs.write("5");
+}
+
+qint64 peakRss() {
+  QFile status("/proc/self/status");
+  if (status.open(QIODevice::ReadOnly))
+    for (auto line : status.readAll().split('\n'))
+      if (line.startsWith("VmHWM:"))
+        return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef Q_OS_MACOS
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// manifest to settled downloads, the way the window goes through it
+void install(VersionManager *manager, const QString &phase,
+             bool report = true) {
+  QEventLoop loop;
+  QElapsedTimer timer;
+  Launcher *launcher = nullptr;
+  bool done = false;
+  resetPeakRss();
+  auto calls = readWriteCalls();
+  timer.start();
+
+  // with AMETRINE_TRACE set, each phase shows up around its spans
+  TraceScope scope("bench", phase);
+
+  // a revalidated manifest calls back again, possibly well after we're done
+  auto fetched = QSharedPointer<bool>::create(false);
+  manager->fetchManifest([&, fetched](const VersionManifest &manifest) {
+    if (*fetched || manifest.latestRelease.isEmpty())
+      return;
+
+    *fetched = true;
+    manager->fetchVersion(manifest, "bench", [&](auto version) {
+      manager->fetchAssets(version, [&, version](auto assets) {
+        manager->fetchRuntime(version, [&, version, assets](auto runtime) {
+          launcher = new Launcher(version, assets, runtime);
+          launcher->settled = [&]() {
+            done = true;
+            loop.quit();
+          };
+          launcher->install();
+        });
+      });
+    });
+  });
+  if (!done)
+    loop.exec();
+
+  auto elapsed = timer.elapsed();
+  auto &metrics = launcher->metrics();
+  if (report) {
+    printf("%-5s %8lld ms %8lld kB rss %8lld rw calls %6lld requests "
+           "%6lld hits %4lld failed\n",
+           qPrintable(phase), elapsed, peakRss(),
+           calls < 0 ? -1 : readWriteCalls() - calls,
+           qint64(metrics.requests), qint64(metrics.cacheHits),
+           qint64(metrics.failed));
+    fflush(stdout);
+  }
+  delete launcher;
+}
+
+// cold and warm are a single install in a process of their own. hot goes
+// through it once first, so the version manager and all the process-wide
+// state are loaded
+int phase(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("ametrine");
+  QCoreApplication::setOrganizationDomain("rinici.de");
+
+  QString name = argv[2];
+  auto manager = new VersionManager;
+  if (name == "hot")
+    install(manager, name, false);
+  install(manager, name);
+  return 0;
+}
+
+// the calls strace -c counted, of the ones that look at paths
+qint64 pathCalls(const QString &summary) {
+  static const QSet<QByteArray> counted = {
+      "stat",   "lstat",     "fstat",      "newfstatat", "statx",
+      "open",   "openat",    "access",     "faccessat",  "faccessat2",
+      "mkdir",  "mkdirat",   "readlink",   "readlinkat"};
+
+  QFile file(summary);
+  if (!file.open(QIODevice::ReadOnly))
+    return -1;
+
+  // % time, seconds, usecs/call, calls, maybe errors, then the name
+  qint64 count = 0;
+  for (auto line : file.readAll().split('\n')) {
+    auto fields = line.simplified().split(' ');
+    if (fields.size() >= 5 && counted.contains(fields.last()))
+      count += fields[3].toLongLong();
+  }
+  return count;
+}
+
+int runPhase(const QString &name) {
+  QProcess process;
+  process.setProcessChannelMode(QProcess::ForwardedChannels);
+
+  auto self = QCoreApplication::applicationFilePath();
+  QTemporaryDir dir;
+  auto summary = dir.filePath("strace");
+  auto strace = QStandardPaths::findExecutable("strace");
+  bool traced = qEnvironmentVariableIsSet("AMETRINE_BENCH_STRACE") &&
+                !strace.isEmpty();
+  if (traced)
+    process.start(strace, {"-f", "-c", "-o", summary, self, "phase", name});
+  else
+    process.start(self, {"phase", name});
+
+  process.waitForFinished(-1);
+  if (traced) {
+    printf("%-5s %8lld stat/open/mkdir calls\n", qPrintable(name),
+           pathCalls(summary));
+    fflush(stdout);
+  }
+  return process.exitCode();
+}
+
+int serve(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  FixtureServer server;
+  populate(server);
+
+  printf("%s\n", qPrintable(server.url({})));
+  fflush(stdout);
+  return app.exec();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && !strcmp(argv[1], "serve"))
+    return serve(argc, argv);
+  if (argc > 2 && !strcmp(argv[1], "phase"))
+    return phase(argc, argv);
+
+  // everything the launcher writes ends up in here
+  QTemporaryDir home;
+  for (auto dir : {"XDG_DATA_HOME", "XDG_CACHE_HOME", "XDG_CONFIG_HOME"})
+    qputenv(dir, home.filePath(dir).toUtf8());
+
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("ametrine");
+  QCoreApplication::setOrganizationDomain("rinici.de");
+
+  QProcess fixture;
+  fixture.start(QCoreApplication::applicationFilePath(), {"serve"});
+  if (!fixture.waitForReadyRead(120000)) {
+    qWarning() << "fixture server didn't come up";
+    return 1;
+  }
+  auto base = QString::fromLatin1(fixture.readLine().trimmed());
+
+  QSettings settings;
+  settings.setValue("mirrors/manifest", base + "manifest.json");
+  settings.setValue("mirrors/runtimes", base + "runtimes.json");
+  settings.setValue("mirrors/resources", QStringList{base + "resources"});
+  settings.setValue("mirrors/libraries", QStringList{base + "libraries"});
+  settings.sync();
+
+  // cold starts from nothing, warm from everything on disk but nothing in
+  // memory, hot keeps everything it loaded the time before
+  for (auto name : {"cold", "warm", "hot"})
+    runPhase(name);
+
+  fixture.kill();
+  fixture.waitForFinished();
+  return 0;
+}
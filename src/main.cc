@@ -1,6 +1,35 @@
 #include <QtNetwork>
 #include <QtWidgets>
 
+#include <zlib.h>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#ifdef Q_OS_MACOS
+#include <sys/clonefile.h>
+#include <sys/resource.h>
+#include <sys/sysctl.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <vector>
+
 #ifdef Q_OS_LINUX
 const QString OS_NAME = "linux";
 #elif Q_OS_WIN
@@ -21,6 +50,147 @@ const QString PISTON_URL =
     "https://piston-meta.mojang.com/mc/game/version_manifest_v2.json";
 const QString RESOURCES_ENDPOINT = "https://resources.download.minecraft.net/";
 const QString LIBRARIES_ENDPOINT = "https://libraries.minecraft.net/";
+const QString RUNTIMES_URL =
+    "https://launchermeta.mojang.com/v1/products/java-runtime/"
+    "2ec0cc96c44e5a76b9c8b7c39df7210883d12871/all.json";
+
+// qt won't open more than 6 connections per host anyway, but a single http/2
+// connection happily multiplexes a lot more than that
+const int DEFAULT_HOST_LIMIT = 6;
+const int HTTP2_HOST_LIMIT = 48;
+const int MAX_ATTEMPTS = 5;
+const int RETRY_BASE_MS = 500;
+const int STALL_TIMEOUT_MS = 30000; // without a byte coming in
+// replies are drained in chunks this size, and never buffer much more than it
+const qint64 CHUNK_SIZE = 64 * 1024;
+
+// files at least this big can be resumed, and are split into ranges when
+// they're even bigger
+const qint64 RESUME_MIN_SIZE = 1024 * 1024;
+const qint64 PARALLEL_MIN_SIZE = 8 * 1024 * 1024;
+const qint64 SIDECAR_INTERVAL = 4 * 1024 * 1024;
+const int RANGE_CHUNKS = 4;
+
+// client jars can be patched from whichever of the newest few installed ones
+// has most in common, in at most so many requests. unchanged runs shorter
+// than the gap are fetched along with their neighbours
+const int DELTA_CANDIDATES = 4;
+const int MAX_DELTA_RANGES = 32;
+const qint64 DELTA_MERGE_GAP = 64 * 1024;
+
+// file i/o happens on threads of its own, with this many jobs in the air each
+const int IO_RING_SIZE = 256;
+const int IO_RING_RESERVE = 16; // left for everything but incoming data
+const int MAX_IO_THREADS = 4;
+
+// while a game is running downloads keep to this, in KiB/s
+const qint64 BACKGROUND_RATE = 512;
+const int RATE_TICK_MS = 25;
+
+const qint64 THROUGHPUT_WINDOW_MS = 5000;
+const int LATENCY_BUCKETS = 16; // powers of two, in ms
+const int PROGRESS_INTERVAL_MS = 200;
+
+// only the tail of the game's output is kept, however much it writes
+const int LOG_LINES = 5000;
+const int MAX_LOG_LINE = 16 * 1024; // longer ones are cut short
+const int MAX_LOG_EVENT = 256 * 1024;
+const int LOG_INTERVAL_MS = 100;
+
+// default heap is a quarter of physical memory, within these, in MiB
+const qint64 MIN_HEAP = 1024;
+const qint64 MAX_HEAP = 8192;
+
+const quint32 INDEX_MAGIC = 0x414d4958; // "AMIX"
+const quint32 INDEX_VERSION = 1;
+
+const quint32 CACHE_MAGIC = 0x414d5043; // "AMPC"
+const quint32 CACHE_VERSION = 14;
+const int PARSED_MEMO = 8; // of each kind, kept in memory as well
+
+// spans of the launcher's own work, as chrome trace events. with
+// AMETRINE_TRACE set they're written there once the game is started and on
+// exit, for chrome://tracing or perfetto. without it a span is one branch
+const bool TRACING = qEnvironmentVariableIsSet("AMETRINE_TRACE");
+
+class Tracer {
+public:
+  static Tracer &instance();
+  qint64 now() const { return clock.nsecsElapsed() / 1000; }
+  void add(const char *name, qint64 start, const QString &detail);
+  void save();
+
+private:
+  Tracer();
+
+  QElapsedTimer clock;
+  QMutex mutex;
+  QJsonArray events;
+};
+
+Tracer::Tracer() {
+  clock.start();
+  qAddPostRoutine([]() { Tracer::instance().save(); });
+}
+
+Tracer &Tracer::instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::add(const char *name, qint64 start, const QString &detail) {
+  // the viewer wants small thread ids, so threads are numbered as they come
+  static std::atomic<int> threads{0};
+  thread_local int thread = ++threads;
+
+  QJsonObject event{{"name", name},
+                    {"cat", "ametrine"},
+                    {"ph", "X"},
+                    {"ts", start},
+                    {"dur", now() - start},
+                    {"pid", QCoreApplication::applicationPid()},
+                    {"tid", thread}};
+  if (!detail.isEmpty())
+    event["args"] = QJsonObject{{"detail", detail}};
+
+  QMutexLocker lock(&mutex);
+  events << event;
+}
+
+void Tracer::save() {
+  QMutexLocker lock(&mutex);
+  QSaveFile file(qEnvironmentVariable("AMETRINE_TRACE"));
+  if (!file.open(QIODevice::WriteOnly))
+    return;
+
+  QJsonObject trace{{"traceEvents", events}, {"displayTimeUnit", "ms"}};
+  file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+  file.commit();
+}
+
+// in µs, or -1 when not tracing. for spans that end in a callback
+qint64 traceStart() { return TRACING ? Tracer::instance().now() : -1; }
+
+void traceEnd(const char *name, qint64 start, const QString &detail = {}) {
+  if (start >= 0)
+    Tracer::instance().add(name, start, detail);
+}
+
+// a span over the enclosing scope
+class TraceScope {
+public:
+  explicit TraceScope(const char *name, const QString &detail = {})
+      : name(name), start(traceStart()) {
+    if (TRACING)
+      this->detail = detail;
+  }
+  ~TraceScope() { traceEnd(name, start, detail); }
+
+private:
+  const char *name;
+  qint64 start;
+  QString detail;
+};
 
 QDir getDataDirectory() {
   return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
@@ -30,53 +200,333 @@ QDir getCacheDirectory() {
   return QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
 }
 
-bool checkRules(QJsonValue rules) {
+// how the runtime manifest names the platform we're on
+QString runtimePlatform() {
+  auto arch = QSysInfo::currentCpuArchitecture();
+  if (OS_NAME == "linux")
+    return arch == "i386" ? "linux-i386" : "linux";
+  if (OS_NAME == "osx")
+    return arch == "arm64" ? "mac-os-arm64" : "mac-os";
+  if (OS_NAME == "windows")
+    return arch == "arm64" ? "windows-arm64"
+           : arch == "i386" ? "windows-x86"
+                            : "windows-x64";
+  return {};
+}
+
+// what java reports as os.version, which is what the rules are written for
+QString osVersion() {
+#ifdef Q_OS_MACOS
+  return QSysInfo::productVersion();
+#else
+  return QSysInfo::kernelVersion();
+#endif
+}
+
+// a rule applies when everything it asks about holds. none of the optional
+// features are supported, so rules asking for one never do
+bool ruleMatches(const QJsonValue &rule) {
+  auto os = rule["os"];
+  if (os["name"].isString() && os["name"].toString() != OS_NAME)
+    return false;
+  if (os["arch"].isString() && os["arch"].toString() != OS_ARCH)
+    return false;
+  QRegularExpression version(os["version"].toString());
+  if (os["version"].isString() && !version.match(osVersion()).hasMatch())
+    return false;
+
+  auto features = rule["features"].toObject();
+  for (auto it = features.constBegin(); it != features.constEnd(); it++)
+    if (it.value().toBool())
+      return false;
+
+  return true;
+}
+
+// the last rule that applies decides, and nothing is allowed unless one does.
+// most libraries with rules share them with a dozen others, so the outcome is
+// kept for every shape seen so far
+bool checkRules(const QJsonValue &rules) {
   if (!rules.isArray())
     return true;
 
-  for (QJsonValue rule : rules.toArray()) {
-    auto os = rule["os"];
-    bool match = !os["name"].isUndefined()   ? os["name"] == OS_NAME
-                 : !os["arch"].isUndefined() ? os["arch"] == OS_ARCH
-                                             : false;
+  static thread_local QHash<QByteArray, bool> cache;
+  auto key = QJsonDocument(rules.toArray()).toJson(QJsonDocument::Compact);
+  auto cached = cache.constFind(key);
+  if (cached != cache.constEnd())
+    return *cached;
 
-    if ((rule["action"] == "allow" && !match) ||
-        (rule["action"] == "disallow" && match)) {
-      return false;
+  bool allowed = false;
+  for (QJsonValue rule : rules.toArray())
+    if (ruleMatches(rule))
+      allowed = rule["action"] == "allow";
+
+  cache.insert(key, allowed);
+  return allowed;
+}
+
+// natives since 1.19 are listed once per architecture under the same os rule,
+// as natives-<os>[-<arch>] classifiers, where no arch means x86_64. the
+// rules can't tell them apart, and they'd all flatten into the same names
+bool nativeArchMatches(const QString &name) {
+  auto at = name.indexOf(":natives-");
+  if (at < 0)
+    return true;
+
+  auto parts = name.mid(at + 1).section('@', 0, 0).split('-');
+  auto arch = parts.mid(2).join('-');
+  static const QHash<QString, QString> arches{
+      {"", "x86_64"}, {"x86", "i386"}, {"arm64", "arm64"}, {"arm32", "arm"}};
+  return arches.value(arch, arch) == QSysInfo::currentCpuArchitecture();
+}
+
+// arguments since 1.13, each either plain or behind rules like libraries
+QStringList parseArguments(const QJsonValue &list) {
+  QStringList args;
+  for (QJsonValue arg : list.toArray()) {
+    if (arg.isString()) {
+      args << arg.toString();
+      continue;
+    }
+    if (!checkRules(arg["rules"]))
+      continue;
+
+    auto value = arg["value"];
+    if (value.isString())
+      args << value.toString();
+    for (auto part : value.toArray())
+      args << part.toString();
+  }
+  return args;
+}
+
+// group:artifact:version[:classifier][@extension], the way maven writes them
+struct Coordinate {
+  QString group;
+  QString artifact;
+  QString version;
+  QString classifier;
+  QString extension = "jar";
+
+  static Coordinate parse(QString name) {
+    Coordinate coordinate;
+    auto at = name.indexOf('@');
+    if (at >= 0) {
+      coordinate.extension = name.mid(at + 1);
+      name.truncate(at);
     }
+
+    auto parts = name.split(':');
+    if (parts.size() < 3)
+      return {};
+
+    coordinate.group = parts[0];
+    coordinate.artifact = parts[1];
+    coordinate.version = parts[2];
+    coordinate.classifier = parts.value(3);
+    return coordinate;
   }
 
-  return true;
+  bool isValid() const { return !artifact.isEmpty(); }
+
+  // the same library regardless of its version
+  QString key() const { return group + ":" + artifact + ":" + classifier; }
+
+  QString path() const {
+    auto file = artifact + "-" + version;
+    if (!classifier.isEmpty())
+      file += "-" + classifier;
+
+    return QString(group).replace('.', '/') + "/" + artifact + "/" + version +
+           "/" + file + "." + extension;
+  }
+};
+
+// by their numeric parts first, then with anything after them coming before
+// plain releases, so 1.0-beta < 1.0 < 1.0.1
+int compareVersions(const QString &a, const QString &b) {
+  int suffixA, suffixB;
+  auto numberA = QVersionNumber::fromString(a, &suffixA);
+  auto numberB = QVersionNumber::fromString(b, &suffixB);
+  auto result = QVersionNumber::compare(numberA, numberB);
+  if (result != 0)
+    return result;
+
+  auto restA = a.midRef(suffixA), restB = b.midRef(suffixB);
+  if (restA.isEmpty() != restB.isEmpty())
+    return restA.isEmpty() ? 1 : -1;
+  return restA.compare(restB);
+}
+
+struct VersionEntry {
+  QString id;
+  QString type; // release, snapshot, old_beta or old_alpha
+  QDateTime releaseTime;
+  QString url;
+  QString sha1;
+};
+
+QDataStream &operator<<(QDataStream &stream, const VersionEntry &entry) {
+  return stream << entry.id << entry.type << entry.releaseTime << entry.url
+                << entry.sha1;
+}
+
+QDataStream &operator>>(QDataStream &stream, VersionEntry &entry) {
+  return stream >> entry.id >> entry.type >> entry.releaseTime >> entry.url >>
+         entry.sha1;
 }
 
 class VersionManifest {
 public:
+  QByteArray etag;
+  QByteArray lastModified;
   QString latestRelease;
   QString latestSnapshot;
-  QMap<QString, QString> versionUrls;
+  QVector<VersionEntry> versions; // newest first
+
+  const VersionEntry *find(const QString &id) const {
+    auto it = index.constFind(id);
+    return it == index.constEnd() ? nullptr : &versions[*it];
+  }
+
+  void reindex() {
+    index.clear();
+    index.reserve(versions.size());
+    for (int i = 0; i < versions.size(); i++)
+      index[versions[i].id] = i;
+  }
 
   static VersionManifest fromJson(const QJsonDocument &data) {
     VersionManifest manifest;
     manifest.latestRelease = data["latest"]["release"].toString();
     manifest.latestSnapshot = data["latest"]["snapshot"].toString();
-    for (QJsonValue version : data["versions"].toArray()) {
-      manifest.versionUrls[version["id"].toString()] =
-          version["url"].toString();
+
+    auto versions = data["versions"].toArray();
+    manifest.versions.reserve(versions.size());
+    for (QJsonValue version : versions) {
+      auto time = version["releaseTime"].toString();
+      manifest.versions << VersionEntry{
+          version["id"].toString(), version["type"].toString(),
+          QDateTime::fromString(time, Qt::ISODate), version["url"].toString(),
+          version["sha1"].toString()};
     }
+
+    // mojang lists them in order already, but nothing promises that
+    std::stable_sort(manifest.versions.begin(), manifest.versions.end(),
+                     [](auto &a, auto &b) {
+                       return a.releaseTime > b.releaseTime;
+                     });
+    manifest.reindex();
     return manifest;
   }
+
+private:
+  QHash<QString, int> index;
+};
+
+QDataStream &operator<<(QDataStream &stream, const VersionManifest &manifest) {
+  return stream << manifest.etag << manifest.lastModified
+                << manifest.latestRelease << manifest.latestSnapshot
+                << manifest.versions;
+}
+
+QDataStream &operator>>(QDataStream &stream, VersionManifest &manifest) {
+  stream >> manifest.etag >> manifest.lastModified >>
+      manifest.latestRelease >> manifest.latestSnapshot >> manifest.versions;
+  manifest.reindex();
+  return stream;
+}
+
+struct Artifact {
+  QString name; // maven coordinate, for libraries
+  QString path;
+  QString url;
+  QByteArray sha1;
+  qint64 size = -1;
+
+  static Artifact fromJson(const QJsonValue &data) {
+    Artifact artifact;
+    artifact.path = data["path"].toString();
+    artifact.url = data["url"].toString();
+    artifact.sha1 = QByteArray::fromHex(data["sha1"].toString().toLatin1());
+    // without one the size is left unchecked
+    if (data["size"].isDouble())
+      artifact.size = data["size"].toVariant().toLongLong();
+    return artifact;
+  }
+};
+
+QDataStream &operator<<(QDataStream &stream, const Artifact &artifact) {
+  return stream << artifact.name << artifact.path << artifact.url
+                << artifact.sha1 << artifact.size;
+}
+
+QDataStream &operator>>(QDataStream &stream, Artifact &artifact) {
+  return stream >> artifact.name >> artifact.path >> artifact.url >>
+         artifact.sha1 >> artifact.size;
+}
+
+struct Native {
+  Artifact artifact;
+  QStringList exclude;
 };
 
+QDataStream &operator<<(QDataStream &stream, const Native &native) {
+  return stream << native.artifact << native.exclude;
+}
+
+QDataStream &operator>>(QDataStream &stream, Native &native) {
+  return stream >> native.artifact >> native.exclude;
+}
+
+// the same library at several versions only goes on the classpath once, at
+// the newest one, wherever it first showed up
+QVector<Artifact> dedupeLibraries(const QVector<Artifact> &libraries) {
+  QVector<Artifact> result;
+  result.reserve(libraries.size());
+  QHash<QString, int> seen;
+
+  for (auto &lib : libraries) {
+    auto coordinate = Coordinate::parse(lib.name);
+    if (!coordinate.isValid()) {
+      result << lib;
+      continue;
+    }
+
+    auto it = seen.constFind(coordinate.key());
+    if (it == seen.constEnd()) {
+      seen[coordinate.key()] = result.size();
+      result << lib;
+    } else if (compareVersions(coordinate.version,
+                               Coordinate::parse(result[*it].name).version) >
+               0) {
+      result[*it] = lib;
+    }
+  }
+
+  return result;
+}
+
 class VersionInfo {
 public:
   QString id;
+  // of the version json, as listed in the manifest. once inherited it's
+  // over the whole chain, so a parent being republished changes it too
+  QString sha1;
   QString type;
   QString mainClass;
   QString assets;
-  QString assetIndex;
-  QString clientJar;
+  Artifact assetIndex;
+  Artifact clientJar;
   quint16 jvmVersion; // java will definitely exhaust uint8 by 2030
-  QStringList libraries;
+  QString jvmComponent;
+  Artifact logConfig; // path is just the file name
+  QString logArgument;
+  QStringList gameArguments; // with ${variables} still in them
+  QStringList jvmArguments;
+  bool legacyArguments = false; // a whole minecraftArguments string
+  QVector<Artifact> libraries;
+  QVector<Native> natives;
 
   static VersionInfo fromJson(const QString &id, const QJsonDocument &data) {
     VersionInfo info;
@@ -84,252 +534,4518 @@ public:
     info.type = data["type"].toString();
     info.mainClass = data["mainClass"].toString();
     info.assets = data["assets"].toString();
-    info.assetIndex = data["assetIndex"]["url"].toString();
-    info.clientJar = data["downloads"]["client"]["url"].toString();
-    info.jvmVersion = data["javaVersion"]["majorVersion"].toInt();
+    info.assetIndex = Artifact::fromJson(data["assetIndex"]);
+    info.clientJar = Artifact::fromJson(data["downloads"]["client"]);
+
+    // versions older than the field all ran on java 8, ones inheriting from
+    // another get it from there
+    bool inherits = data["inheritsFrom"].isString();
+    info.jvmVersion =
+        data["javaVersion"]["majorVersion"].toInt(inherits ? 0 : 8);
+    info.jvmComponent = data["javaVersion"]["component"].toString(
+        inherits ? QString() : "jre-legacy");
+
+    auto logging = data["logging"]["client"];
+    info.logConfig = Artifact::fromJson(logging["file"]);
+    info.logConfig.path = logging["file"]["id"].toString();
+    info.logArgument = logging["argument"].toString();
+
+    if (data["minecraftArguments"].isString()) {
+      info.gameArguments = data["minecraftArguments"].toString().split(
+          ' ', Qt::SkipEmptyParts);
+      info.legacyArguments = true;
+    } else {
+      info.gameArguments = parseArguments(data["arguments"]["game"]);
+    }
+    info.jvmArguments = parseArguments(data["arguments"]["jvm"]);
+
+    QVector<Native> natives;
     for (QJsonValue lib : data["libraries"].toArray()) {
       if (!checkRules(lib["rules"]))
         continue;
 
-      info.libraries << lib["downloads"]["artifact"]["path"].toString();
+      auto name = lib["name"].toString();
+      auto downloads = lib["downloads"];
+      QStringList exclude;
+      for (auto path : lib["extract"]["exclude"].toArray())
+        exclude << path.toString();
+
+      // since 1.19 natives are plain libraries, before that they were hidden
+      // away in classifiers
+      if (!nativeArchMatches(name))
+        continue;
+      if (downloads["artifact"].isObject()) {
+        auto artifact = Artifact::fromJson(downloads["artifact"]);
+        artifact.name = name;
+        info.libraries << artifact;
+        if (name.contains(":natives-"))
+          natives << Native{artifact, exclude};
+      } else if (downloads.isUndefined() && !name.isEmpty()) {
+        // modloaders only name theirs, and say which repository has them
+        auto coordinate = Coordinate::parse(name);
+        auto repository = lib["url"].toString(LIBRARIES_ENDPOINT);
+        if (!repository.endsWith('/'))
+          repository += '/';
+
+        Artifact artifact;
+        artifact.name = name;
+        artifact.path = coordinate.path();
+        artifact.url = repository + artifact.path;
+        artifact.sha1 = QByteArray::fromHex(lib["sha1"].toString().toLatin1());
+        if (lib["size"].isDouble())
+          artifact.size = lib["size"].toVariant().toLongLong();
+        if (coordinate.isValid())
+          info.libraries << artifact;
+      }
+
+      auto classifier = lib["natives"][OS_NAME].toString();
+      classifier.replace("${arch}", QString::number(QSysInfo::WordSize));
+      if (!classifier.isEmpty()) {
+        auto artifact = downloads["classifiers"][classifier];
+        info.natives << Native{Artifact::fromJson(artifact), exclude};
+      }
     }
 
+    info.libraries = dedupeLibraries(info.libraries);
+    info.addNatives(natives);
     return info;
   }
-};
 
-class VersionManager : QObject {
-public:
-  explicit VersionManager();
-  VersionManifest fetchManifest();
-  VersionInfo fetchVersion(const VersionManifest &manifest, const QString &id);
-  QJsonDocument fetchAssets(const VersionInfo &version);
+  // modloaders only list what they add or change on top of another version
+  void inherit(const VersionInfo &parent) {
+    if (type.isEmpty())
+      type = parent.type;
+    if (mainClass.isEmpty())
+      mainClass = parent.mainClass;
+    if (assets.isEmpty()) {
+      assets = parent.assets;
+      assetIndex = parent.assetIndex;
+    }
+    if (clientJar.url.isEmpty())
+      clientJar = parent.clientJar;
+    if (jvmComponent.isEmpty()) {
+      jvmVersion = parent.jvmVersion;
+      jvmComponent = parent.jvmComponent;
+    }
+    if (logConfig.url.isEmpty()) {
+      logConfig = parent.logConfig;
+      logArgument = parent.logArgument;
+    }
+
+    // a minecraftArguments string repeats everything, lists only add to
+    // the parent's, --launchTarget and the like
+    if (!legacyArguments) {
+      gameArguments = parent.gameArguments + gameArguments;
+      legacyArguments = parent.legacyArguments;
+    }
+    jvmArguments = parent.jvmArguments + jvmArguments;
+    if (!sha1.isEmpty() && !parent.sha1.isEmpty())
+      sha1 = QString::fromLatin1(
+          QCryptographicHash::hash((sha1 + parent.sha1).toLatin1(),
+                                   QCryptographicHash::Sha1)
+              .toHex());
+
+    // ours go first, so they win over the parent's at the same version
+    auto ours = natives;
+    libraries = dedupeLibraries(libraries + parent.libraries);
+    natives.clear();
+    addNatives(ours + parent.natives);
+  }
 
 private:
-  QJsonDocument fetchJson(const QNetworkRequest &req);
-  QJsonDocument fetchJson(const QUrl &url);
+  // natives that are libraries only stay if the library did
+  void addNatives(const QVector<Native> &candidates) {
+    QSet<QString> paths, added;
+    for (auto &lib : libraries)
+      paths << lib.path;
 
-  QNetworkDiskCache *cache;
-  QNetworkAccessManager *client;
-};
+    for (auto &native : candidates) {
+      auto &path = native.artifact.path;
+      bool library = !native.artifact.name.isEmpty();
+      if ((library && !paths.contains(path)) || added.contains(path))
+        continue;
 
-VersionManager::VersionManager() {
-  cache = new QNetworkDiskCache(this);
-  cache->setCacheDirectory(getCacheDirectory().filePath("network"));
+      added << path;
+      natives << native;
+    }
+  }
+};
 
-  client = new QNetworkAccessManager(this);
-  client->setCache(cache);
+QDataStream &operator<<(QDataStream &stream, const VersionInfo &info) {
+  return stream << info.id << info.sha1 << info.type << info.mainClass
+                << info.assets << info.assetIndex << info.clientJar
+                << info.jvmVersion << info.jvmComponent << info.logConfig
+                << info.logArgument << info.gameArguments << info.jvmArguments
+                << info.legacyArguments << info.libraries << info.natives;
 }
 
-VersionManifest VersionManager::fetchManifest() {
-  return VersionManifest::fromJson(fetchJson(PISTON_URL));
+QDataStream &operator>>(QDataStream &stream, VersionInfo &info) {
+  return stream >> info.id >> info.sha1 >> info.type >> info.mainClass >>
+         info.assets >> info.assetIndex >> info.clientJar >> info.jvmVersion >>
+         info.jvmComponent >> info.logConfig >> info.logArgument >>
+         info.gameArguments >> info.jvmArguments >> info.legacyArguments >>
+         info.libraries >> info.natives;
 }
 
-VersionInfo VersionManager::fetchVersion(const VersionManifest &manifest,
-                                         const QString &id) {
-  auto request = QNetworkRequest(manifest.versionUrls[id]);
-  request.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
-                       QNetworkRequest::PreferCache);
-  return VersionInfo::fromJson(id, fetchJson(request));
-}
+// lower values are fetched first. critical downloads make up the classpath
+// and gate the launch, deferrable ones are only needed once the game is up
+enum class Priority { Critical, Normal, Deferrable };
 
-QJsonDocument VersionManager::fetchAssets(const VersionInfo &version) {
-  auto request = QNetworkRequest(version.assetIndex);
-  request.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
-                       QNetworkRequest::PreferCache);
-  return fetchJson(request);
-}
+Priority assetPriority(QLatin1String name) {
+  if (name.startsWith(QLatin1String("minecraft/")))
+    name = name.mid(10);
 
-QJsonDocument VersionManager::fetchJson(const QNetworkRequest &req) {
-  auto reply = client->get(req);
-  while (reply->isRunning()) {
-    qApp->processEvents();
-    reply->waitForReadyRead(-1);
-  }
-  return QJsonDocument::fromJson(reply->readAll());
-}
+  // used lazily by the game, so they can wait until everything else is done
+  for (auto prefix : {"sounds/", "sound/", "newsound/", "music/", "textures/"})
+    if (name.startsWith(QLatin1String(prefix)))
+      return Priority::Deferrable;
 
-QJsonDocument VersionManager::fetchJson(const QUrl &url) {
-  return fetchJson(QNetworkRequest(url));
+  return Priority::Normal;
 }
 
-class Launcher : QObject {
+// names are only needed to pick a priority, so they're never kept around
+struct AssetObject {
+  char hash[20];
+  qint64 size;
+  Priority priority;
+
+  QByteArray sha1() const { return QByteArray(hash, sizeof(hash)); }
+};
+
+// walks the reply in place. keys and values are looked at where they are
+// instead of being copied out, which for an index of a few thousand objects
+// is most of what QJsonDocument spent its time and memory on
+class JsonScanner {
 public:
-  Launcher(const VersionInfo &version, const QJsonDocument &assets);
-  void launchGame();
+  JsonScanner(const QByteArray &data)
+      : p(data.constData()), end(data.constData() + data.size()) {}
 
-private:
-  void downloadFiles();
-  void downloadAsset(const QString &url, const QString &path);
-  void jvmArgs();
-  void gameArgs();
+  // names are only ever wanted for the old layouts, which is rare enough to
+  // go through the whole thing again for
+  bool objects(std::vector<AssetObject> &objects,
+               QStringList *names = nullptr);
 
-  VersionInfo version;
-  QJsonDocument assets;
-  QMap<QNetworkReply *, QString> pending;
-  QNetworkAccessManager *client;
-  QStringList args;
+  bool isVirtual = false;
+  bool mapToResources = false;
 
-  QDir dataDir;
-  QString assetsDir;
-  QString librariesDir;
-  QString gameDir;
-  QString versionDir;
-  QString nativesDir;
+private:
+  bool skipSpace();
+  bool consume(char c);
+  bool string(QLatin1String &value);
+  static QString unescape(QLatin1String value);
+  bool number(qint64 &value);
+  bool hash(char *out);
+  bool skipValue();
+  bool object(AssetObject &object);
+
+  const char *p;
+  const char *end;
 };
 
-Launcher::Launcher(const VersionInfo &version, const QJsonDocument &assets)
-    : version(version), assets(assets) {
-  dataDir = getDataDirectory();
-  assetsDir = dataDir.filePath("assets");
-  librariesDir = dataDir.filePath("libraries");
-  gameDir = dataDir.filePath("instances/" + version.id + "/minecraft");
-  versionDir = dataDir.filePath("versions/" + version.id);
-  nativesDir = getCacheDirectory().filePath("natives");
+bool JsonScanner::skipSpace() {
+  while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+    p++;
+  return p < end;
 }
 
-void Launcher::launchGame() {
-  QDir(nativesDir).mkpath(".");
+bool JsonScanner::consume(char c) {
+  if (!skipSpace() || *p != c)
+    return false;
+  p++;
+  return true;
+}
 
-  downloadFiles();
+// escapes are left as they are. keys and hashes have none, names are the
+// only thing that might, and go through unescape
+bool JsonScanner::string(QLatin1String &value) {
+  if (!consume('"'))
+    return false;
 
-  jvmArgs();
-  gameArgs();
+  auto start = p;
+  while (p < end && *p != '"')
+    p += *p == '\\' ? 2 : 1;
+  if (p >= end)
+    return false;
 
-  auto game = new QProcess;
-  game->setProcessChannelMode(QProcess::ForwardedChannels);
-  game->start("/usr/lib/jvm/java-21-openjdk/bin/java", args);
+  value = QLatin1String(start, p++ - start);
+  return true;
 }
 
-void Launcher::jvmArgs() {
-  QString classpath;
-  for (auto lib : version.libraries) {
-    classpath += librariesDir + "/" + lib;
-    classpath += QDir::listSeparator();
-  }
-  classpath += versionDir + "/client.jar";
+// names come out as files on disk, a literal backslash in there would be
+// wrong. only ever seen with \/ or gson's \u003d, so qt can do those
+QString JsonScanner::unescape(QLatin1String value) {
+  QByteArray raw(value.data(), value.size());
+  if (!raw.contains('\\'))
+    return QString::fromUtf8(raw);
 
-#ifdef Q_OS_MACOS
-  args << "-XstartOnFirstThread";
-#endif
-#ifdef Q_OS_WIN
-  args << "-XX:HeapDumpPath=MojangTricksIntelDriversForPerformance_javaw.exe_"
-          "minecraft.exe.heapdump";
-#endif
-#ifdef Q_PROCESSOR_X86_32
-  args << "-Xss1M";
-#endif
-  args << "-Djava.library.path=" + nativesDir;
-  args << "-Djna.tmpdir=" + nativesDir;
-  args << "-Dorg.lwjgl.system.SharedLibraryExtractPath=" + nativesDir;
-  args << "-Dio.netty.native.workdir=" + nativesDir;
-  args << "-Dminecraft.launcher.brand=Ametrine";
-  args << "-Dminecraft.launcher.version=0.1.0";
-  // args << "-Dlog4j.configurationFile=${path}";
-  args << "-cp" << classpath;
-  args << version.mainClass;
+  auto array = QJsonDocument::fromJson("[\"" + raw + "\"]").array();
+  if (array.isEmpty())
+    qWarning() << "skipping asset with a broken name" << raw;
+  return array.isEmpty() ? QString() : array.first().toString();
 }
 
-void Launcher::gameArgs() {
-  args << "--username" << USERNAME;
-  args << "--version" << version.id;
-  args << "--gameDir" << gameDir;
-  args << "--assetsDir" << assetsDir;
-  args << "--assetIndex" << version.assets;
-  args << "--accessToken"
-       << "";
-  args << "--versionType" << version.type;
+bool JsonScanner::number(qint64 &value) {
+  skipSpace();
+  auto start = p;
+  for (value = 0; p < end && *p >= '0' && *p <= '9'; p++)
+    value = value * 10 + (*p - '0');
+  return p > start;
 }
 
-void Launcher::downloadFiles() {
-  client = new QNetworkAccessManager(this);
-  connect(client, &QNetworkAccessManager::finished, [&](QNetworkReply *reply) {
-    auto path = pending.take(reply);
-    QFileInfo(path).dir().mkpath(".");
+bool JsonScanner::hash(char *out) {
+  QLatin1String hex;
+  if (!string(hex) || hex.size() != 40)
+    return false;
 
-    QFile file(path);
-    file.open(QIODevice::WriteOnly);
-    file.write(reply->readAll());
-    file.close();
+  auto nibble = [](char c) {
+    return c >= '0' && c <= '9'   ? c - '0'
+           : c >= 'a' && c <= 'f' ? c - 'a' + 10
+           : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                  : -1;
+  };
 
-    reply->deleteLater();
+  for (int i = 0; i < 20; i++) {
+    auto high = nibble(hex.at(i * 2).toLatin1());
+    auto low = nibble(hex.at(i * 2 + 1).toLatin1());
+    if (high < 0 || low < 0)
+      return false;
+    out[i] = char(high << 4 | low);
+  }
 
-    qDebug() << path;
-    qDebug() << pending.size() << "assets left";
-  });
+  return true;
+}
 
-  for (auto lib : version.libraries) {
-    downloadAsset(LIBRARIES_ENDPOINT + lib, librariesDir + "/" + lib);
-  }
+bool JsonScanner::skipValue() {
+  if (!skipSpace())
+    return false;
 
-  auto objects = assets["objects"].toObject();
-  for (auto obj = objects.constBegin(); obj != objects.constEnd(); obj++) {
-    auto hash = obj.value()["hash"].toString();
-    auto entry = hash.left(2) + "/" + hash;
-    downloadAsset(RESOURCES_ENDPOINT + entry, assetsDir + "/objects/" + entry);
-  }
+  QLatin1String ignored;
+  if (*p == '"')
+    return string(ignored);
 
-  downloadAsset(version.clientJar, versionDir + "/client.jar");
+  if (*p != '{' && *p != '[') {
+    while (p < end && *p != ',' && *p != '}' && *p != ']')
+      p++;
+    return p < end;
+  }
 
-  QFile index(assetsDir + "/indexes/" + version.assets + ".json");
-  QFileInfo(index).dir().mkpath(".");
+  // only brackets outside of strings count
+  int depth = 0;
+  do {
+    if (*p == '"') {
+      if (!string(ignored))
+        return false;
+      continue;
+    }
+    if (*p == '{' || *p == '[')
+      depth++;
+    else if (*p == '}' || *p == ']')
+      depth--;
+    p++;
+  } while (depth > 0 && p < end);
 
-  index.open(QIODevice::WriteOnly);
-  index.write(assets.toJson(QJsonDocument::Compact));
-  index.close();
+  return depth == 0;
 }
 
-void Launcher::downloadAsset(const QString &url, const QString &path) {
-  if (QFileInfo(path).exists())
-    return;
+bool JsonScanner::object(AssetObject &object) {
+  if (!consume('{'))
+    return false;
 
-  auto reply = client->get(QNetworkRequest(url));
-  pending[reply] = path;
-}
+  bool hasHash = false, hasSize = false;
+  while (!consume('}')) {
+    QLatin1String key;
+    if (!string(key) || !consume(':'))
+      return false;
 
-class MainWindow : public QMainWindow {
-public:
-  explicit MainWindow();
+    bool ok = key == QLatin1String("hash")   ? (hasHash = hash(object.hash))
+              : key == QLatin1String("size") ? (hasSize = number(object.size))
+                                             : skipValue();
+    if (!ok)
+      return false;
+    consume(',');
+  }
 
-private:
-  void createVersionList();
-};
+  return hasHash && hasSize;
+}
 
-MainWindow::MainWindow() { createVersionList(); }
+bool JsonScanner::objects(std::vector<AssetObject> &objects,
+                          QStringList *names) {
+  if (!consume('{'))
+    return false;
 
-void MainWindow::createVersionList() {
-  setCursor(Qt::WaitCursor);
-  auto manager = new VersionManager;
-  auto manifest = manager->fetchManifest();
-  unsetCursor();
+  while (!consume('}')) {
+    QLatin1String key;
+    if (!string(key) || !consume(':'))
+      return false;
+
+    if (key != QLatin1String("objects")) {
+      skipSpace();
+      bool set = p < end && *p == 't';
+      if (key == QLatin1String("virtual"))
+        isVirtual = set;
+      else if (key == QLatin1String("map_to_resources"))
+        mapToResources = set;
+
+      if (!skipValue())
+        return false;
+      consume(',');
+      continue;
+    }
+
+    if (!consume('{'))
+      return false;
+
+    while (!consume('}')) {
+      QLatin1String name;
+      AssetObject object;
+      if (!string(name) || !consume(':') || !this->object(object))
+        return false;
+
+      object.priority = assetPriority(name);
+      objects.push_back(object);
+      if (names)
+        *names << unescape(name);
+      consume(',');
+    }
+    consume(',');
+  }
+
+  return true;
+}
+
+class AssetIndex {
+public:
+  QByteArray data; // as served, the game reads it back from disk
+  std::vector<AssetObject> objects;
+  // laid out by name for versions before 1.7, under assets/virtual or in
+  // the game directory respectively
+  bool isVirtual = false;
+  bool mapToResources = false;
+
+  static AssetIndex fromJson(const QByteArray &data) {
+    AssetIndex index;
+    index.data = data;
+
+    // each object takes up a little over 100 bytes of json
+    JsonScanner scanner(data);
+    index.objects.reserve(data.size() / 96);
+    if (!scanner.objects(index.objects)) {
+      qWarning() << "malformed asset index";
+      index.objects.clear();
+    }
+    index.objects.shrink_to_fit();
+    index.isVirtual = scanner.isVirtual;
+    index.mapToResources = scanner.mapToResources;
+
+    return index;
+  }
+
+  // in the same order as objects
+  QStringList names() const {
+    std::vector<AssetObject> objects;
+    QStringList names;
+    JsonScanner(data).objects(objects, &names);
+    return names;
+  }
+};
+
+QDataStream &operator<<(QDataStream &stream, const AssetIndex &index) {
+  stream << index.data << index.isVirtual << index.mapToResources
+         << quint32(index.objects.size());
+  for (auto &obj : index.objects) {
+    stream.writeRawData(obj.hash, sizeof(obj.hash));
+    stream << obj.size << quint8(obj.priority);
+  }
+  return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, AssetIndex &index) {
+  quint32 count;
+  stream >> index.data >> index.isVirtual >> index.mapToResources >> count;
+  // every object came out of data, which puts a bound on them
+  if (count > quint32(index.data.size()))
+    stream.setStatus(QDataStream::ReadCorruptData);
+  if (stream.status() != QDataStream::Ok)
+    return stream;
+
+  index.objects.resize(count);
+  for (auto &obj : index.objects) {
+    quint8 priority;
+    stream.readRawData(obj.hash, sizeof(obj.hash));
+    stream >> obj.size >> priority;
+    obj.priority = Priority(priority);
+  }
+  return stream;
+}
+
+struct RuntimeFile {
+  QString path;
+  Artifact download; // files only
+  QString target;    // links only
+  bool executable = false;
+};
+
+// one of mojang's java builds, laid out file by file
+class JavaRuntime {
+public:
+  QString component;
+  QString version;
+  QVector<RuntimeFile> files;
+  QStringList directories;
+
+  bool isEmpty() const { return files.isEmpty(); }
+
+  static JavaRuntime fromJson(const QString &component,
+                              const QString &version,
+                              const QJsonDocument &data) {
+    JavaRuntime runtime;
+    runtime.component = component;
+    runtime.version = version;
+
+    auto files = data["files"].toObject();
+    runtime.files.reserve(files.size());
+    for (auto it = files.constBegin(); it != files.constEnd(); it++) {
+      auto type = it.value()["type"].toString();
+      if (type == "directory") {
+        runtime.directories << it.key();
+        continue;
+      }
+
+      // the lzma variants are smaller, but we'd need another dependency
+      RuntimeFile file;
+      file.path = it.key();
+      file.executable = it.value()["executable"].toBool();
+      if (type == "link")
+        file.target = it.value()["target"].toString();
+      else if (type == "file")
+        file.download = Artifact::fromJson(it.value()["downloads"]["raw"]);
+      else
+        continue;
+
+      runtime.files << file;
+    }
+
+    return runtime;
+  }
+};
+
+QDataStream &operator<<(QDataStream &stream, const RuntimeFile &file) {
+  return stream << file.path << file.download << file.target
+                << file.executable;
+}
+
+QDataStream &operator>>(QDataStream &stream, RuntimeFile &file) {
+  return stream >> file.path >> file.download >> file.target >>
+         file.executable;
+}
+
+QDataStream &operator<<(QDataStream &stream, const JavaRuntime &runtime) {
+  return stream << runtime.component << runtime.version << runtime.files
+                << runtime.directories;
+}
+
+QDataStream &operator>>(QDataStream &stream, JavaRuntime &runtime) {
+  return stream >> runtime.component >> runtime.version >> runtime.files >>
+         runtime.directories;
+}
+
+// what the list of runtimes has for our platform: the newest manifest of
+// each component, and the version it's named as
+class RuntimeList {
+public:
+  QHash<QString, Artifact> manifests;
+  QHash<QString, QString> names;
+
+  static RuntimeList fromJson(const QJsonDocument &data) {
+    RuntimeList list;
+    auto components = data[runtimePlatform()].toObject();
+    for (auto it = components.constBegin(); it != components.constEnd();
+         it++) {
+      auto releases = it.value().toArray();
+      if (releases.isEmpty())
+        continue;
+
+      QJsonValue release = releases.first();
+      list.manifests[it.key()] = Artifact::fromJson(release["manifest"]);
+      list.names[it.key()] = release["version"]["name"].toString();
+    }
+    return list;
+  }
+};
+
+QDataStream &operator<<(QDataStream &stream, const RuntimeList &list) {
+  return stream << list.manifests << list.names;
+}
+
+QDataStream &operator>>(QDataStream &stream, RuntimeList &list) {
+  return stream >> list.manifests >> list.names;
+}
+
+template <typename T> using Callback = std::function<void(const T &)>;
+
+// everything here is asynchronous, callbacks run on the event loop once the
+// reply is in. failed requests hand over empty results.
+//
+// parsed documents are kept in a binary cache, so startup doesn't need to
+// touch any json. the manifest is served stale and revalidated afterwards,
+// meaning fetchManifest may call back a second time with the fresh one.
+// everything else is addressed by sha1 and cached forever
+class VersionManager : QObject {
+public:
+  explicit VersionManager();
+  void fetchManifest(Callback<VersionManifest> callback);
+  void fetchVersion(const VersionManifest &manifest, const QString &id,
+                    Callback<VersionInfo> callback);
+  void fetchAssets(const VersionInfo &version, Callback<AssetIndex> callback);
+  void fetchRuntime(const VersionInfo &version, Callback<JavaRuntime> callback);
+  void prefetch(const VersionManifest &manifest, const QString &id);
+
+private:
+  void get(const QNetworkRequest &req,
+           std::function<void(QNetworkReply *)> callback);
+  void fetchCached(const QUrl &url, const QByteArray &sha1,
+                   Callback<QByteArray> callback);
+  void fetchLocal(const VersionManifest &manifest, const QString &id,
+                  Callback<VersionInfo> callback, int depth);
+
+  template <typename T> bool loadParsed(const QString &key, T &value);
+  template <typename T> void saveParsed(const QString &key, const T &value);
+
+  // the last few loaded or parsed, by cache key, so picking a version and
+  // then launching it only goes to the disk once. picked out by type
+  auto &memo(VersionManifest *) { return manifests; }
+  auto &memo(VersionInfo *) { return versions; }
+  auto &memo(AssetIndex *) { return indexes; }
+  auto &memo(JavaRuntime *) { return runtimes; }
+  auto &memo(RuntimeList *) { return runtimeLists; }
+
+  QNetworkDiskCache *cache;
+  QNetworkAccessManager *client;
+  QDir parsedDir;
+  QHash<QUrl, QVector<Callback<QByteArray>>> waiting;
+  QCache<QString, VersionManifest> manifests{PARSED_MEMO};
+  QCache<QString, VersionInfo> versions{PARSED_MEMO};
+  QCache<QString, AssetIndex> indexes{PARSED_MEMO};
+  QCache<QString, JavaRuntime> runtimes{PARSED_MEMO};
+  QCache<QString, RuntimeList> runtimeLists{PARSED_MEMO};
+};
+
+VersionManager::VersionManager() {
+  cache = new QNetworkDiskCache(this);
+  cache->setCacheDirectory(getCacheDirectory().filePath("network"));
+
+  client = new QNetworkAccessManager(this);
+  client->setCache(cache);
+
+  parsedDir = getCacheDirectory().filePath("parsed");
+  parsedDir.mkpath(".");
+}
+
+void VersionManager::fetchManifest(Callback<VersionManifest> callback) {
+  auto start = traceStart();
+  VersionManifest cached;
+  bool hit = loadParsed("manifest", cached);
+  if (hit)
+    callback(cached);
+
+  // revalidated by hand against what we parsed last, the disk cache would
+  // only get in the way of that
+  auto url = QSettings().value("mirrors/manifest", PISTON_URL).toUrl();
+  auto request = QNetworkRequest(url);
+  request.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
+                       QNetworkRequest::AlwaysNetwork);
+  request.setAttribute(QNetworkRequest::CacheSaveControlAttribute, false);
+  if (hit && !cached.etag.isEmpty())
+    request.setRawHeader("If-None-Match", cached.etag);
+  if (hit && !cached.lastModified.isEmpty())
+    request.setRawHeader("If-Modified-Since", cached.lastModified);
+
+  get(request, [=](QNetworkReply *reply) {
+    // a 304 may still be answered from an old disk cache entry
+    auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    auto stale = reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute);
+    traceEnd("fetchManifest", start);
+    if (reply->error() != QNetworkReply::NoError || status.toInt() != 200 ||
+        stale.toBool()) {
+      if (!hit)
+        callback({});
+      return;
+    }
+
+    TraceScope scope("parse manifest");
+    auto data = QJsonDocument::fromJson(reply->readAll());
+    auto manifest = VersionManifest::fromJson(data);
+    manifest.etag = reply->rawHeader("ETag");
+    manifest.lastModified = reply->rawHeader("Last-Modified");
+    if (!manifest.versions.isEmpty())
+      saveParsed("manifest", manifest);
+
+    callback(manifest);
+  });
+}
+
+void VersionManager::fetchVersion(const VersionManifest &manifest,
+                                  const QString &id,
+                                  Callback<VersionInfo> callback) {
+  auto entry = manifest.find(id);
+  if (!entry) {
+    fetchLocal(manifest, id, callback, 0);
+    return;
+  }
+
+  // keyed by the sha1 the manifest has for it, so it can't go stale
+  auto start = traceStart();
+  auto sha1 = entry->sha1;
+  auto key = sha1.isEmpty() ? QString() : sha1 + ".version";
+
+  VersionInfo cached;
+  if (loadParsed(key, cached)) {
+    traceEnd("fetchVersion", start, id);
+    callback(cached);
+    return;
+  }
+
+  auto hash = QByteArray::fromHex(sha1.toLatin1());
+  fetchCached(entry->url, hash, [=](const QByteArray &data) {
+    VersionInfo info;
+    {
+      TraceScope scope("parse version", id);
+      info = VersionInfo::fromJson(id, QJsonDocument::fromJson(data));
+      info.sha1 = sha1;
+      if (!data.isEmpty())
+        saveParsed(key, info);
+    }
+
+    traceEnd("fetchVersion", start, id);
+    callback(info);
+  });
+}
+
+// versions the manifest doesn't know about, modloaders mostly, are put into
+// versions/<id>/<id>.json by their installers, usually on top of one it does
+void VersionManager::fetchLocal(const VersionManifest &manifest,
+                                const QString &id,
+                                Callback<VersionInfo> callback, int depth) {
+  auto path = QString("versions/%1/%1.json").arg(id);
+  QFile file(getDataDirectory().filePath(path));
+  if (depth > 8 || !file.open(QIODevice::ReadOnly)) {
+    qWarning() << "no version" << id;
+    callback({});
+    return;
+  }
+
+  auto data = file.readAll();
+  auto json = QJsonDocument::fromJson(data);
+  auto info = VersionInfo::fromJson(id, json);
+  auto hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+  info.sha1 = QString::fromLatin1(hash.toHex());
+
+  auto parent = json["inheritsFrom"].toString();
+  if (parent.isEmpty()) {
+    callback(info);
+    return;
+  }
+
+  auto inherit = [=](const VersionInfo &base) {
+    if (base.mainClass.isEmpty()) {
+      callback({});
+      return;
+    }
+
+    auto merged = info;
+    merged.inherit(base);
+    callback(merged);
+  };
+
+  if (manifest.find(parent))
+    fetchVersion(manifest, parent, inherit);
+  else
+    fetchLocal(manifest, parent, inherit, depth + 1);
+}
+
+void VersionManager::fetchAssets(const VersionInfo &version,
+                                 Callback<AssetIndex> callback) {
+  auto start = traceStart();
+  auto sha1 = QString::fromLatin1(version.assetIndex.sha1.toHex());
+  auto key = sha1.isEmpty() ? QString() : sha1 + ".assets";
+
+  AssetIndex cached;
+  if (loadParsed(key, cached)) {
+    traceEnd("fetchAssets", start, version.assets);
+    callback(cached);
+    return;
+  }
+
+  auto assets = version.assets;
+  auto &listed = version.assetIndex;
+  fetchCached(listed.url, listed.sha1, [=](const QByteArray &data) {
+    AssetIndex index;
+    {
+      TraceScope scope("parse assets", assets);
+      index = AssetIndex::fromJson(data);
+      if (!data.isEmpty())
+        saveParsed(key, index);
+    }
+
+    traceEnd("fetchAssets", start, assets);
+    callback(index);
+  });
+}
+
+void VersionManager::fetchRuntime(const VersionInfo &version,
+                                  Callback<JavaRuntime> callback) {
+  // the list of runtimes does get updated in place, but whatever it pointed
+  // to before is still around, so a stale copy is fine
+  auto start = traceStart();
+  auto url = QSettings().value("mirrors/runtimes", RUNTIMES_URL).toUrl();
+  auto component = version.jvmComponent;
+  auto listKey = QString::fromLatin1(
+                     QCryptographicHash::hash(url.toEncoded(),
+                                              QCryptographicHash::Sha1)
+                         .toHex()) +
+                 ".runtimes";
+
+  auto found = [=](const RuntimeList &list) {
+    if (!list.manifests.contains(component)) {
+      callback({});
+      return;
+    }
+
+    auto manifest = list.manifests[component];
+    auto name = list.names[component];
+    auto sha1 = QString::fromLatin1(manifest.sha1.toHex());
+    auto key = sha1.isEmpty() ? QString() : sha1 + ".runtime";
+
+    JavaRuntime cached;
+    if (loadParsed(key, cached)) {
+      traceEnd("fetchRuntime", start, component);
+      callback(cached);
+      return;
+    }
+
+    fetchCached(manifest.url, manifest.sha1, [=](const QByteArray &data) {
+      auto runtime =
+          JavaRuntime::fromJson(component, name, QJsonDocument::fromJson(data));
+      if (!runtime.isEmpty())
+        saveParsed(key, runtime);
+
+      traceEnd("fetchRuntime", start, component);
+      callback(runtime);
+    });
+  };
+
+  // the parsed list is kept by url, only a component it doesn't have yet
+  // sends us back to the json
+  RuntimeList cached;
+  if (loadParsed(listKey, cached) && cached.manifests.contains(component)) {
+    found(cached);
+    return;
+  }
+
+  fetchCached(url, {}, [=](const QByteArray &data) {
+    RuntimeList list;
+    {
+      TraceScope scope("parse runtimes", component);
+      list = RuntimeList::fromJson(QJsonDocument::fromJson(data));
+      if (!list.manifests.isEmpty())
+        saveParsed(listKey, list);
+    }
+    found(list);
+  });
+}
+
+void VersionManager::prefetch(const VersionManifest &manifest,
+                              const QString &id) {
+  // the asset index goes out as soon as the version tells us where it is
+  fetchVersion(manifest, id, [=](const VersionInfo &version) {
+    if (!version.assetIndex.url.isEmpty())
+      fetchAssets(version, [](const AssetIndex &) {});
+    fetchRuntime(version, [](const JavaRuntime &) {});
+  });
+}
+
+void VersionManager::get(const QNetworkRequest &req,
+                         std::function<void(QNetworkReply *)> callback) {
+  auto start = traceStart();
+  auto reply = client->get(req);
+  connect(reply, &QNetworkReply::finished, this, [=]() {
+    reply->deleteLater();
+    traceEnd("GET", start, TRACING ? req.url().toString() : QString());
+
+    // cache misses are expected, the caller goes to the network next
+    auto control = req.attribute(QNetworkRequest::CacheLoadControlAttribute);
+    if (reply->error() != QNetworkReply::NoError &&
+        control.toInt() != QNetworkRequest::AlwaysCache)
+      qWarning() << "failed to fetch" << req.url() << reply->errorString();
+
+    callback(reply);
+  });
+}
+
+void VersionManager::fetchCached(const QUrl &url, const QByteArray &sha1,
+                                 Callback<QByteArray> callback) {
+  // these never change under the same url, so whoever asks first fetches it
+  // and everyone else joins in
+  auto &callbacks = waiting[url];
+  callbacks << callback;
+  if (callbacks.size() > 1)
+    return;
+
+  // a portal or proxy page comes back just as fine as the real thing, and
+  // would be parsed and kept forever. whatever doesn't hash to what it was
+  // listed as is thrown out of the disk cache too, so it isn't served again
+  auto fetched = [=](QNetworkReply *reply, QByteArray &data) {
+    if (reply->error() != QNetworkReply::NoError)
+      return false;
+
+    data = reply->readAll();
+    if (sha1.isEmpty() ||
+        QCryptographicHash::hash(data, QCryptographicHash::Sha1) == sha1)
+      return true;
+
+    qWarning() << "checksum mismatch for" << url;
+    cache->remove(url);
+    data.clear();
+    return false;
+  };
+
+  auto deliver = [=](const QByteArray &data) {
+    for (auto callback : waiting.take(url))
+      callback(data);
+  };
+
+  // whatever is in the disk cache is good regardless of its expiry headers,
+  // and anything that isn't is fetched without revalidation
+  auto request = QNetworkRequest(url);
+  request.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
+                       QNetworkRequest::AlwaysCache);
+  get(request, [=](QNetworkReply *reply) {
+    QByteArray data;
+    if (fetched(reply, data)) {
+      deliver(data);
+      return;
+    }
+
+    auto request = QNetworkRequest(url);
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
+                         QNetworkRequest::AlwaysNetwork);
+    get(request, [=](QNetworkReply *reply) {
+      QByteArray data;
+      fetched(reply, data);
+      deliver(data);
+    });
+  });
+}
+
+template <typename T>
+bool VersionManager::loadParsed(const QString &key, T &value) {
+  if (key.isEmpty())
+    return false;
+
+  auto &kept = memo(static_cast<T *>(nullptr));
+  if (auto hit = kept.object(key)) {
+    value = *hit;
+    return true;
+  }
+
+  TraceScope scope("loadParsed", key);
+  QFile file(parsedDir.filePath(key));
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QDataStream stream(file.readAll());
+  quint32 magic, version;
+  stream >> magic >> version;
+  if (magic != CACHE_MAGIC || version != CACHE_VERSION)
+    return false;
+
+  stream.setVersion(QDataStream::Qt_5_12);
+  stream >> value;
+  if (stream.status() != QDataStream::Ok)
+    return false;
+
+  kept.insert(key, new T(value));
+  return true;
+}
+
+template <typename T>
+void VersionManager::saveParsed(const QString &key, const T &value) {
+  if (!key.isEmpty())
+    memo(static_cast<T *>(nullptr)).insert(key, new T(value));
+
+  QSaveFile file(parsedDir.filePath(key));
+  if (key.isEmpty() || !file.open(QIODevice::WriteOnly))
+    return;
+
+  QDataStream stream(&file);
+  stream << CACHE_MAGIC << CACHE_VERSION;
+  stream.setVersion(QDataStream::Qt_5_12);
+  stream << value;
+  file.commit();
+}
+
+struct Download {
+  QUrl url;
+  QString path;
+  Priority priority = Priority::Normal;
+  QByteArray sha1; // unchecked if empty
+  qint64 size = -1;
+  qint64 mtime = -1; // once it's in place, as the worker found it
+  int attempts = 0;
+  QList<QUrl> mirrors; // tried in order once url gives up
+};
+
+// the same path under each configured mirror, and finally the official one
+QList<QUrl> mirrored(const QStringList &endpoints, const QString &path) {
+  QList<QUrl> urls;
+  for (auto endpoint : endpoints)
+    urls << QUrl(endpoint + path);
+  return urls;
+}
+
+QStringList endpoints(const QString &mirrors, const QString &official) {
+  QStringList endpoints;
+  for (auto mirror : QSettings().value(mirrors).toStringList())
+    endpoints << (mirror.endsWith('/') ? mirror : mirror + '/');
+  if (!official.isEmpty())
+    endpoints << official;
+  return endpoints;
+}
+
+// everything the scheduler goes through, and whatever the launcher found
+// was already there. bytes only count downloads with a known size
+struct DownloadMetrics {
+  QElapsedTimer clock;
+  int requests = 0;
+  int inFlight = 0;
+  int completed = 0;
+  int failed = 0;
+  int retries = 0;
+  int cacheHits = 0;
+  qint64 bytesExpected = 0;
+  qint64 bytesSettled = 0;
+  qint64 bytesReceived = 0;
+  qint64 timeToLaunch = -1;
+  QHash<QString, QVector<int>> latency;   // until the first data came in
+  QHash<QString, QVector<int>> durations; // of the whole transfer
+
+  DownloadMetrics() { clock.start(); }
+  void receive(qint64 bytes);
+  // firstData is -1 if nothing came in at all
+  void record(const QString &host, qint64 firstData, qint64 duration);
+  double throughput();
+  QJsonObject toJson();
+
+private:
+  void prune(qint64 now);
+  static void add(QVector<int> &buckets, qint64 ms);
+  static QJsonObject toJson(const QHash<QString, QVector<int>> &histograms);
+
+  QQueue<QPair<qint64, qint64>> samples;
+  qint64 windowBytes = 0;
+};
+
+void DownloadMetrics::receive(qint64 bytes) {
+  auto now = clock.elapsed();
+  prune(now);
+
+  bytesReceived += bytes;
+  windowBytes += bytes;
+  samples.enqueue({now, bytes});
+}
+
+void DownloadMetrics::prune(qint64 now) {
+  auto start = now - THROUGHPUT_WINDOW_MS;
+  while (!samples.isEmpty() && samples.head().first < start)
+    windowBytes -= samples.dequeue().second;
+}
+
+void DownloadMetrics::record(const QString &host, qint64 firstData,
+                             qint64 duration) {
+  if (firstData >= 0)
+    add(latency[host], firstData);
+  add(durations[host], duration);
+}
+
+void DownloadMetrics::add(QVector<int> &buckets, qint64 ms) {
+  buckets.resize(LATENCY_BUCKETS);
+
+  int bucket = 0;
+  while (ms > 1 && bucket < LATENCY_BUCKETS - 1) {
+    ms >>= 1;
+    bucket++;
+  }
+  buckets[bucket]++;
+}
+
+double DownloadMetrics::throughput() {
+  // bytes per second over the last few seconds
+  auto now = clock.elapsed();
+  prune(now);
+
+  auto window = qMin(now, THROUGHPUT_WINDOW_MS);
+  return window > 0 ? windowBytes * 1000.0 / window : 0;
+}
+
+QJsonObject
+DownloadMetrics::toJson(const QHash<QString, QVector<int>> &histograms) {
+  QJsonObject hosts;
+  for (auto it = histograms.constBegin(); it != histograms.constEnd(); it++) {
+    QJsonArray buckets;
+    for (auto count : *it)
+      buckets << count;
+    hosts[it.key()] = buckets;
+  }
+  return hosts;
+}
+
+QJsonObject DownloadMetrics::toJson() {
+  return {
+      {"elapsedMs", clock.elapsed()},
+      {"requests", requests},
+      {"inFlight", inFlight},
+      {"completed", completed},
+      {"failed", failed},
+      {"retries", retries},
+      {"cacheHits", cacheHits},
+      {"bytesExpected", bytesExpected},
+      {"bytesSettled", bytesSettled},
+      {"bytesReceived", bytesReceived},
+      {"bytesPerSecond", throughput()},
+      {"timeToLaunchMs", timeToLaunch},
+      {"latencyHistogramMs", toJson(latency)},
+      {"transferHistogramMs", toJson(durations)},
+  };
+}
+
+// hands jobs from the gui thread to a single worker. the indices are plain
+// atomics, the semaphores only come into it when the ring runs empty or full.
+// incoming data checks for room first and waits in its reply otherwise, so
+// only the rare control jobs could ever block, and they have slots reserved
+class IoRing {
+public:
+  bool hasRoom(int slots) const { return space.available() > slots; }
+  void push(std::function<void()> job);
+  std::function<void()> pop();
+
+private:
+  std::function<void()> jobs[IO_RING_SIZE];
+  std::atomic<quint64> head{0};
+  std::atomic<quint64> tail{0};
+  QSemaphore space{IO_RING_SIZE};
+  QSemaphore filled;
+};
+
+void IoRing::push(std::function<void()> job) {
+  space.acquire();
+  auto index = tail.load(std::memory_order_relaxed);
+  jobs[index % IO_RING_SIZE] = std::move(job);
+  tail.store(index + 1, std::memory_order_release);
+  filled.release();
+}
+
+std::function<void()> IoRing::pop() {
+  filled.acquire();
+  auto index = head.load(std::memory_order_relaxed);
+  auto job = std::move(jobs[index % IO_RING_SIZE]);
+  head.store(index + 1, std::memory_order_release);
+  space.release();
+  return job;
+}
+
+// threads that do nothing but file i/o. jobs posted to the same worker run in
+// order, so everything touching one file goes through one of them
+class IoPool {
+public:
+  explicit IoPool(int threads);
+  ~IoPool();
+  int size() const { return int(workers.size()); }
+  // whether incoming data can be posted without waiting for the disk
+  bool ready(int worker) const {
+    return workers[worker]->ring.hasRoom(IO_RING_RESERVE);
+  }
+  void post(int worker, std::function<void()> job);
+
+private:
+  struct Worker {
+    IoRing ring;
+    QThread *thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+};
+
+IoPool::IoPool(int threads) {
+  for (int i = 0; i < qMax(threads, 1); i++) {
+    auto worker = new Worker;
+    worker->thread = QThread::create([worker]() {
+      // an empty job says there won't be any more
+      while (auto job = worker->ring.pop())
+        job();
+    });
+    worker->thread->start();
+    workers.emplace_back(worker);
+  }
+}
+
+IoPool::~IoPool() {
+  // whatever is still queued gets written out first
+  for (auto &worker : workers)
+    worker->ring.push({});
+  for (auto &worker : workers) {
+    worker->thread->wait();
+    delete worker->thread;
+  }
+}
+
+void IoPool::post(int worker, std::function<void()> job) {
+  workers[worker]->ring.push(std::move(job));
+}
+
+// for the calling thread only. in the background its disk access waits for
+// everyone else's, which is mostly the game loading chunks
+void setBackgroundIo(bool background) {
+#if defined(Q_OS_LINUX)
+  // best effort class, lowest level. idle could starve us outright
+  const int IOPRIO_WHO_PROCESS = 1;
+  const int IOPRIO_LOWEST = 2 << 13 | 7;
+  syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+          background ? IOPRIO_LOWEST : 0);
+#elif defined(Q_OS_WIN)
+  SetThreadPriority(GetCurrentThread(), background
+                                            ? THREAD_MODE_BACKGROUND_BEGIN
+                                            : THREAD_MODE_BACKGROUND_END);
+#elif defined(Q_OS_MACOS)
+  setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD,
+                 background ? IOPOL_THROTTLE : IOPOL_DEFAULT);
+#else
+  Q_UNUSED(background);
+#endif
+}
+
+// a token bucket over everything one scheduler receives. it only holds a
+// quarter second's worth, so time spent idle doesn't come back as a burst
+class RateLimiter {
+public:
+  bool limited() const { return rate > 0; }
+  qint64 available();
+  void take(qint64 bytes) { tokens -= bytes; }
+  void setRate(qint64 bytesPerSecond);
+
+private:
+  double capacity() const { return qMax(rate / 4.0, 16 * 1024.0); }
+
+  qint64 rate = 0; // 0 for no limit
+  double tokens = 0;
+  QElapsedTimer clock;
+};
+
+qint64 RateLimiter::available() {
+  auto elapsed = clock.nsecsElapsed();
+  clock.restart();
+  tokens = qMin(capacity(), tokens + elapsed * 1e-9 * rate);
+  return qint64(tokens);
+}
+
+void RateLimiter::setRate(qint64 bytesPerSecond) {
+  rate = bytesPerSecond;
+  tokens = 0;
+  clock.start();
+}
+
+class DownloadScheduler : QObject {
+public:
+  explicit DownloadScheduler(QObject *parent = nullptr);
+  ~DownloadScheduler();
+  void enqueue(const Download &download);
+  int remaining() const;
+  int remaining(Priority priority) const;
+
+  // every scheduler backs off while any game is running
+  static void gameStarted();
+  static void gameStopped();
+
+  DownloadMetrics metrics;
+  // several launchers may share one scheduler, and all of them are told
+  QVector<std::function<void(const Download &)>> finished;
+  QVector<std::function<void(const Download &, const QString &)>> failed;
+
+private:
+  // a byte range of the file, fetched by its own request
+  struct Chunk {
+    qint64 start;
+    qint64 end; // exclusive, or -1 if the size isn't known
+    qint64 written = 0;
+  };
+
+  // everything goes into <path>.part first. large files also get a sidecar
+  // describing what is already in there, so they can be resumed later.
+  //
+  // the file, hash and ioError belong to the transfer's worker. the rest is
+  // the gui thread's, except while the worker prepares or stores it, when
+  // nothing else is looking
+  struct Transfer {
+    explicit Transfer(const Download &download)
+        : download(download), file(download.path + ".part"),
+          sidecar(download.path + ".part.json"),
+          hash(QCryptographicHash::Sha1) {}
+
+    Download download;
+    QFile file;
+    QString sidecar;
+    QCryptographicHash hash;
+    QElapsedTimer timer;
+    qint64 firstData = -1; // ms into the transfer
+    QVector<Chunk> chunks;
+    QHash<QNetworkReply *, int> replies;
+    QHash<QNetworkReply *, QTimer *> idle;
+    int worker = 0;
+    bool resumable = false;
+    bool streaming = true; // hashed as it comes in, only with a single chunk
+    bool restarted = false;
+    qint64 unsaved = 0;
+    QString error;
+    bool transient = true;
+    QString ioError;
+  };
+
+  struct Host {
+    int limit = DEFAULT_HOST_LIMIT;
+    int inFlight = 0;
+    bool http2 = true;       // cleared if the host turns out to choke on it
+    bool multiplexed = false; // once a reply came back over http/2
+    QQueue<Download> queues[3];
+  };
+
+  void connectHost(const QUrl &url);
+  void negotiated(const QString &name, QNetworkReply *reply);
+
+  void schedule(const Download &download);
+  bool next(const QString &name, Download &download);
+  void pump(const QString &name);
+  void start(const Download &download);
+  void started(Transfer *transfer, const QString &error);
+  void request(Transfer *transfer, int index);
+  void receive(QNetworkReply *reply, bool drain = false);
+  void hold(QNetworkReply *reply);
+  void stalled(QNetworkReply *reply);
+  void resumeThrottled();
+  void applyRate();
+  void restart(Transfer *transfer, QNetworkReply *reply);
+  void complete(QNetworkReply *reply);
+  void finish(Transfer *transfer);
+  void stored(Transfer *transfer, const QString &error, bool again);
+  void checkpoint(Transfer *transfer);
+  void retry(Download download, const QString &error, bool transient = true);
+  void settle(const Download &download, const QString &error = {});
+
+  // run on the transfer's worker
+  static QString prepare(Transfer *transfer, int chunks);
+  static bool resume(Transfer *transfer);
+  static QString store(Transfer *transfer, bool &again);
+  static bool verify(Transfer *transfer, QString &error);
+  static void saveSidecar(Transfer *transfer, const QVector<Chunk> &chunks);
+  static void discard(Transfer *transfer);
+
+  static int &gamesRunning();
+  static QSet<DownloadScheduler *> &instances();
+
+  QSettings settings;
+  QNetworkAccessManager *client;
+  IoPool *io;
+  int nextWorker = 0;
+  QHash<QString, Host> hosts;
+  QHash<QNetworkReply *, Transfer *> active;
+  QSet<QString> pending;
+  int outstanding[3] = {};
+  RateLimiter limiter;
+  QTimer *throttle;
+  QSet<QNetworkReply *> throttled; // with data we're not taking yet
+};
+
+// directories known to exist, so files going into them don't each start with
+// a stat() of every component of their path. shared by all the threads doing
+// file i/o. one that turns out to be gone after all is removed again
+class DirectoryCache {
+public:
+  bool mkpath(const QString &dir);
+  void insert(const QString &dir);
+  void remove(const QString &dir);
+
+private:
+  QMutex mutex;
+  QSet<QString> known;
+};
+
+void DirectoryCache::remove(const QString &dir) {
+  QMutexLocker lock(&mutex);
+  known.remove(dir);
+}
+
+bool DirectoryCache::mkpath(const QString &dir) {
+  {
+    QMutexLocker lock(&mutex);
+    if (known.contains(dir))
+      return true;
+  }
+
+  if (!QDir().mkpath(dir))
+    return false;
+
+  insert(dir);
+  return true;
+}
+
+void DirectoryCache::insert(const QString &dir) {
+  QMutexLocker lock(&mutex);
+  known.insert(dir);
+}
+
+DirectoryCache &directories() {
+  static DirectoryCache cache;
+  return cache;
+}
+
+// QFileInfo::path() doesn't go to the disk for this
+QString parentDir(const QString &path) { return QFileInfo(path).path(); }
+
+// adds the first length bytes of file to hash
+bool hashFile(QFile &file, qint64 length, QCryptographicHash &hash) {
+  if (!file.seek(0))
+    return false;
+
+  char buffer[CHUNK_SIZE];
+  while (length > 0) {
+    auto read = file.read(buffer, qMin<qint64>(length, sizeof buffer));
+    if (read <= 0)
+      return false;
+
+    hash.addData(buffer, read);
+    length -= read;
+  }
+
+  return true;
+}
+
+// rename() that atomically replaces whatever is at to
+bool replaceFile(const QString &from, const QString &to) {
+#ifdef Q_OS_WIN
+  return MoveFileExW((LPCWSTR)from.utf16(), (LPCWSTR)to.utf16(),
+                     MOVEFILE_REPLACE_EXISTING);
+#else
+  return ::rename(QFile::encodeName(from), QFile::encodeName(to)) == 0;
+#endif
+}
+
+// makes to share from's data, as a copy-on-write clone where the filesystem
+// can do that, a hardlink otherwise, and only copies as a last resort
+bool linkFile(const QString &from, const QString &to) {
+  QFile::remove(to);
+  directories().mkpath(parentDir(to));
+
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+  int source = ::open(QFile::encodeName(from), O_RDONLY | O_CLOEXEC);
+  int target = ::open(QFile::encodeName(to),
+                      O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  bool cloned = source >= 0 && target >= 0 &&
+                ::ioctl(target, FICLONE, source) == 0;
+  if (source >= 0)
+    ::close(source);
+  if (target >= 0)
+    ::close(target);
+  if (cloned)
+    return true;
+  if (target >= 0)
+    QFile::remove(to);
+#elif defined(Q_OS_MACOS)
+  if (::clonefile(QFile::encodeName(from), QFile::encodeName(to), 0) == 0)
+    return true;
+#endif
+
+#ifdef Q_OS_WIN
+  if (CreateHardLinkW((LPCWSTR)to.utf16(), (LPCWSTR)from.utf16(), nullptr))
+    return true;
+#else
+  if (::link(QFile::encodeName(from), QFile::encodeName(to)) == 0)
+    return true;
+#endif
+
+  return QFile::copy(from, to);
+}
+
+DownloadScheduler::DownloadScheduler(QObject *parent) : QObject(parent) {
+  client = new QNetworkAccessManager(this);
+
+  auto threads = qBound(1, QThread::idealThreadCount() / 2, MAX_IO_THREADS);
+  io = new IoPool(settings.value("downloads/ioThreads", threads).toInt());
+
+  throttle = new QTimer(this);
+  throttle->setInterval(RATE_TICK_MS);
+  connect(throttle, &QTimer::timeout, this, [this]() { resumeThrottled(); });
+
+  instances() << this;
+  applyRate();
+}
+
+DownloadScheduler::~DownloadScheduler() {
+  instances().remove(this);
+  delete io;
+}
+
+int &DownloadScheduler::gamesRunning() {
+  static int running = 0;
+  return running;
+}
+
+QSet<DownloadScheduler *> &DownloadScheduler::instances() {
+  static QSet<DownloadScheduler *> all;
+  return all;
+}
+
+void DownloadScheduler::gameStarted() {
+  gamesRunning()++;
+  for (auto scheduler : instances())
+    scheduler->applyRate();
+}
+
+void DownloadScheduler::gameStopped() {
+  gamesRunning()--;
+  for (auto scheduler : instances())
+    scheduler->applyRate();
+}
+
+// downloads/maxRate caps everything, and while playing it's at most
+// downloads/backgroundRate, both in KiB/s and 0 for no limit
+void DownloadScheduler::applyRate() {
+  bool background =
+      gamesRunning() > 0 &&
+      settings.value("downloads/throttleWhilePlaying", true).toBool();
+
+  auto rate = settings.value("downloads/maxRate", 0).toLongLong();
+  auto low = settings.value("downloads/backgroundRate", BACKGROUND_RATE)
+                 .toLongLong();
+  if (background && low > 0)
+    rate = rate > 0 ? qMin(rate, low) : low;
+  limiter.setRate(rate * 1024);
+
+  // lifting the limit lifts the connection cap that came with it
+  for (auto &name : hosts.keys())
+    pump(name);
+
+  for (int i = 0; i < io->size(); i++)
+    io->post(i, [background]() { setBackgroundIo(background); });
+}
+
+void DownloadScheduler::enqueue(const Download &download) {
+  // whoever asked for it too hears about it when it settles
+  if (pending.contains(download.path))
+    return;
+
+  pending << download.path;
+  outstanding[int(download.priority)]++;
+  metrics.requests++;
+  metrics.bytesExpected += qMax<qint64>(download.size, 0);
+  schedule(download);
+}
+
+int DownloadScheduler::remaining() const {
+  return std::accumulate(std::begin(outstanding), std::end(outstanding), 0);
+}
+
+int DownloadScheduler::remaining(Priority priority) const {
+  return outstanding[int(priority)];
+}
+
+void DownloadScheduler::schedule(const Download &download) {
+  auto name = download.url.host();
+  if (!hosts.contains(name)) {
+    auto fallback = settings.value("downloads/maxPerHost", DEFAULT_HOST_LIMIT);
+    hosts[name].limit = settings.value("downloads/limits/" + name, fallback)
+                            .toInt();
+    hosts[name].http2 = settings.value("downloads/http2", true).toBool();
+    connectHost(download.url);
+  }
+
+  hosts[name].queues[int(download.priority)].enqueue(download);
+  pump(name);
+}
+
+void DownloadScheduler::connectHost(const QUrl &url) {
+  // get the tls handshake out of the way while the queue fills up
+#ifndef QT_NO_SSL
+  if (url.scheme() != "https")
+    return;
+
+  auto config = QSslConfiguration::defaultConfiguration();
+  if (hosts[url.host()].http2)
+    config.setAllowedNextProtocols({QSslConfiguration::ALPNProtocolHTTP2,
+                                    QSslConfiguration::NextProtocolHttp1_1});
+  client->connectToHostEncrypted(url.host(), url.port(443), config);
+#else
+  client->connectToHost(url.host(), url.port(80));
+#endif
+}
+
+void DownloadScheduler::negotiated(const QString &name, QNetworkReply *reply) {
+  auto &host = hosts[name];
+  if (host.multiplexed ||
+      !reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool())
+    return;
+
+  // explicitly configured limits win, otherwise let the connection carry as
+  // many requests as it can
+  host.multiplexed = true;
+  if (!settings.contains("downloads/limits/" + name))
+    host.limit = settings.value("downloads/http2Limit", HTTP2_HOST_LIMIT)
+                     .toInt();
+}
+
+bool DownloadScheduler::next(const QString &name, Download &download) {
+  // a rate limit means plain http/1.1, and its connection count
+  auto &host = hosts[name];
+  auto limit = host.limit;
+  if (limiter.limited())
+    limit = qMin(limit, DEFAULT_HOST_LIMIT);
+  if (host.inFlight >= limit)
+    return false;
+
+  // the client jar, libraries and assets all come from different hosts, so
+  // priority has to hold across them: nothing else starts anywhere while
+  // something critical is still outstanding
+  bool held = outstanding[int(Priority::Critical)] > 0;
+  for (auto &queue : host.queues) {
+    if (held && &queue != &host.queues[int(Priority::Critical)])
+      break;
+    if (!queue.isEmpty()) {
+      download = queue.dequeue();
+      host.inFlight++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void DownloadScheduler::pump(const QString &name) {
+  // callbacks may enqueue more, so don't hold on to the host in between
+  Download download;
+  while (next(name, download))
+    start(download);
+}
+
+void DownloadScheduler::start(const Download &download) {
+  auto transfer = new Transfer(download);
+  transfer->resumable = download.size >= RESUME_MIN_SIZE;
+  transfer->worker = nextWorker++ % io->size();
+  transfer->timer.start();
+  metrics.inFlight++;
+
+  // big enough to be worth splitting into ranges fetched side by side
+  auto chunks = settings.value("downloads/rangeChunks", RANGE_CHUNKS).toInt();
+  if (download.size < PARALLEL_MIN_SIZE)
+    chunks = 1;
+
+  io->post(transfer->worker, [=]() {
+    auto error = prepare(transfer, chunks);
+    QMetaObject::invokeMethod(
+        this, [=]() { started(transfer, error); }, Qt::QueuedConnection);
+  });
+}
+
+QString DownloadScheduler::prepare(Transfer *transfer, int chunks) {
+  auto &download = transfer->download;
+  auto dir = parentDir(download.path);
+  directories().mkpath(dir);
+
+  if (!resume(transfer)) {
+    transfer->chunks.clear();
+    for (int i = 0; i < chunks; i++) {
+      qint64 end = download.size * (i + 1) / chunks;
+      transfer->chunks << Chunk{download.size * i / chunks,
+                                chunks > 1 ? end : download.size};
+    }
+
+    // read back for hashing when the ranges arrive out of order
+    auto &file = transfer->file;
+    auto mode = QIODevice::ReadWrite | QIODevice::Truncate;
+    bool opened = file.open(mode);
+    if (!opened) {
+      // the directory may have been deleted since it was last made
+      directories().remove(dir);
+      opened = directories().mkpath(dir) && file.open(mode);
+    }
+    if (!opened || (chunks > 1 && !file.resize(download.size)))
+      return file.errorString();
+  }
+
+  transfer->streaming = transfer->chunks.size() == 1;
+  if (transfer->resumable)
+    saveSidecar(transfer, transfer->chunks);
+  return {};
+}
+
+void DownloadScheduler::started(Transfer *transfer, const QString &error) {
+  auto download = transfer->download;
+  if (!error.isNull()) {
+    hosts[download.url.host()].inFlight--;
+    metrics.inFlight--;
+    settle(download, error);
+    delete transfer;
+    pump(download.url.host());
+    return;
+  }
+
+  for (int i = 0; i < transfer->chunks.size(); i++) {
+    auto &chunk = transfer->chunks[i];
+    if (chunk.end < 0 || chunk.start + chunk.written < chunk.end)
+      request(transfer, i);
+  }
+
+  // everything was already there, and just needs verifying
+  if (transfer->replies.isEmpty())
+    finish(transfer);
+}
+
+bool DownloadScheduler::resume(Transfer *transfer) {
+  auto &download = transfer->download;
+  if (!transfer->resumable)
+    return false;
+
+  QFile file(transfer->sidecar);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  auto data = QJsonDocument::fromJson(file.readAll());
+  auto sha1 = QString::fromLatin1(download.sha1.toHex());
+  if (data["sha1"].toString() != sha1 ||
+      data["size"].toVariant().toLongLong() != download.size)
+    return false;
+
+  QVector<Chunk> chunks;
+  qint64 written = 0;
+  for (auto chunk : data["chunks"].toArray()) {
+    auto range = chunk.toArray();
+    chunks << Chunk{range[0].toVariant().toLongLong(),
+                    range[1].toVariant().toLongLong(),
+                    range[2].toVariant().toLongLong()};
+    written = qMax(written, chunks.last().start + chunks.last().written);
+  }
+
+  if (chunks.isEmpty() || transfer->file.size() < written ||
+      !transfer->file.open(QIODevice::ReadWrite))
+    return false;
+
+  // the only part that has to be read back is what came in before, and only
+  // when it's going to be streamed through the hash again
+  if (chunks.size() == 1 &&
+      !hashFile(transfer->file, chunks[0].written, transfer->hash)) {
+    transfer->file.close();
+    return false;
+  }
+
+  qDebug() << "resuming" << download.path;
+  transfer->chunks = chunks;
+  return true;
+}
+
+void DownloadScheduler::request(Transfer *transfer, int index) {
+  auto &download = transfer->download;
+  auto &chunk = transfer->chunks[index];
+
+  // everything to the same host shares its connections, pipelined where the
+  // server is stuck on http/1.1. qt's http/2 opens the flow control window
+  // whether or not we read, so under a rate limit only http/1.1 slows down
+  auto request = QNetworkRequest(download.url);
+  request.setAttribute(QNetworkRequest::Http2AllowedAttribute,
+                       hosts[download.url.host()].http2 &&
+                           !limiter.limited());
+  request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
+
+  auto offset = chunk.start + chunk.written;
+  if (transfer->chunks.size() > 1 || offset > 0) {
+    auto range = QString("bytes=%1-").arg(offset);
+    if (chunk.end >= 0)
+      range += QString::number(chunk.end - 1);
+    request.setRawHeader("Range", range.toLatin1());
+  }
+
+  auto reply = client->get(request);
+  reply->setReadBufferSize(CHUNK_SIZE);
+  transfer->replies[reply] = index;
+  active[reply] = transfer;
+  connect(reply, &QNetworkReply::readyRead, this, [=]() { receive(reply); });
+  connect(reply, &QNetworkReply::finished, this, [=]() { complete(reply); });
+
+  // a connection that just stops sending never errors by itself
+  auto idle = new QTimer(reply);
+  idle->setSingleShot(true);
+  idle->setInterval(STALL_TIMEOUT_MS);
+  connect(idle, &QTimer::timeout, this, [=]() { stalled(reply); });
+  idle->start();
+  transfer->idle[reply] = idle;
+}
+
+// treated like any other dropped connection, so it's retried and picks up
+// from the sidecar where it can
+void DownloadScheduler::stalled(QNetworkReply *reply) {
+  auto transfer = active.value(reply);
+  if (!transfer || !transfer->replies.contains(reply))
+    return;
+
+  qWarning() << "no data from" << reply->url() << "for"
+             << STALL_TIMEOUT_MS / 1000 << "seconds";
+  if (transfer->error.isNull()) {
+    transfer->error = "the connection stalled";
+    transfer->transient = true;
+  }
+  reply->abort();
+}
+
+void DownloadScheduler::receive(QNetworkReply *reply, bool drain) {
+  auto transfer = active.value(reply);
+  if (!transfer || !transfer->replies.contains(reply))
+    return;
+
+  // held back data counts too, the stall is ours then
+  transfer->idle[reply]->start();
+  if (transfer->firstData < 0)
+    transfer->firstData = transfer->timer.elapsed();
+
+  auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+  if (!transfer->restarted && reply->request().hasRawHeader("Range") &&
+      status.toInt() == 200)
+    restart(transfer, reply);
+
+  // a full ring means the disk is behind. the data waits in the reply, which
+  // holds the socket back, instead of the gui thread waiting on the disk
+  if (!drain && !io->ready(transfer->worker)) {
+    hold(reply);
+    return;
+  }
+
+  // the read buffer keeps this to about a chunk, which the worker writes and
+  // hashes while we go back to the sockets. past the rate limit the rest
+  // stays in there, and qt stops reading the socket until we take it. that
+  // doesn't hold for replies already on http/2 when the limit came in, those
+  // would only pile up in qt's buffers, so they're let through
+  bool shaped = limiter.limited() && !drain &&
+                !reply->attribute(QNetworkRequest::Http2WasUsedAttribute)
+                     .toBool();
+  auto budget = reply->bytesAvailable();
+  if (shaped)
+    budget = qBound<qint64>(0, limiter.available(), budget);
+
+  auto data = reply->read(budget);
+  if (limiter.limited())
+    limiter.take(data.size());
+  if (!drain && reply->bytesAvailable() > 0)
+    hold(reply);
+  if (data.isEmpty())
+    return;
+
+  auto &chunk = transfer->chunks[transfer->replies[reply]];
+  auto offset = chunk.start + chunk.written;
+  bool streaming = transfer->streaming;
+  io->post(transfer->worker, [=]() {
+    auto &file = transfer->file;
+    if (!file.seek(offset) || file.write(data) != data.size()) {
+      if (transfer->ioError.isNull())
+        transfer->ioError = file.errorString();
+      return;
+    }
+
+    // hashed as it streams in, so verifying never needs another read pass
+    if (streaming)
+      transfer->hash.addData(data);
+  });
+
+  chunk.written += data.size();
+  transfer->unsaved += data.size();
+  metrics.receive(data.size());
+
+  if (transfer->resumable && transfer->unsaved >= SIDECAR_INTERVAL)
+    checkpoint(transfer);
+}
+
+void DownloadScheduler::hold(QNetworkReply *reply) {
+  throttled << reply;
+  if (!throttle->isActive())
+    throttle->start();
+}
+
+void DownloadScheduler::resumeThrottled() {
+  auto replies = throttled;
+  throttled.clear();
+  for (auto reply : replies)
+    receive(reply);
+
+  if (throttled.isEmpty())
+    throttle->stop();
+}
+
+void DownloadScheduler::restart(Transfer *transfer, QNetworkReply *reply) {
+  // the server ignored our range and sent everything, so start over with
+  // just this reply
+  qDebug() << transfer->download.url.host() << "doesn't do ranges";
+
+  auto others = transfer->replies.keys();
+  others.removeOne(reply);
+
+  transfer->replies.clear();
+  transfer->replies[reply] = 0;
+  for (auto other : others)
+    transfer->idle.remove(other);
+  transfer->chunks = {Chunk{0, transfer->download.size}};
+  transfer->streaming = true;
+  transfer->restarted = true;
+  io->post(transfer->worker, [=]() {
+    transfer->hash.reset();
+    transfer->file.resize(0);
+  });
+
+  // aborting finishes them synchronously, complete ignores them from now on
+  for (auto other : others)
+    other->abort();
+}
+
+void DownloadScheduler::complete(QNetworkReply *reply) {
+  // what's left over can't be handed over without blocking, so come back
+  auto owner = active.value(reply);
+  if (owner && reply->bytesAvailable() > 0 && !io->ready(owner->worker)) {
+    QTimer::singleShot(RATE_TICK_MS, this, [=]() { complete(reply); });
+    return;
+  }
+
+  // a finished reply has at most a chunk left over, that goes in regardless
+  receive(reply, true);
+  throttled.remove(reply);
+
+  auto transfer = active.take(reply);
+  reply->deleteLater();
+  if (!transfer)
+    return;
+
+  transfer->idle.remove(reply);
+  if (!transfer->replies.remove(reply))
+    return;
+
+  auto name = transfer->download.url.host();
+  auto &host = hosts[name];
+  negotiated(name, reply);
+
+  // the first failing range decides what happens to the whole transfer
+  auto error = reply->error();
+  if (error != QNetworkReply::NoError && transfer->error.isNull()) {
+    auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    auto code = status.toInt();
+    transfer->error = reply->errorString();
+    transfer->transient = !status.isValid() || code == 408 || code == 429 ||
+                          code >= 500;
+
+    bool protocol = error == QNetworkReply::ProtocolFailure ||
+                    error == QNetworkReply::ProtocolUnknownError ||
+                    error == QNetworkReply::ProtocolInvalidOperationError;
+    if (protocol && host.http2 && !host.multiplexed) {
+      qDebug() << "falling back to http/1.1 for" << name;
+      host.http2 = false;
+    }
+  }
+
+  if (transfer->replies.isEmpty())
+    finish(transfer);
+}
+
+void DownloadScheduler::finish(Transfer *transfer) {
+  auto name = transfer->download.url.host();
+  hosts[name].inFlight--;
+  metrics.inFlight--;
+  metrics.record(name, transfer->firstData, transfer->timer.elapsed());
+
+  // the connection can go on to the next download while the worker verifies
+  // and moves this one into place
+  io->post(transfer->worker, [=]() {
+    bool again = false;
+    auto error = store(transfer, again);
+    QMetaObject::invokeMethod(
+        this, [=]() { stored(transfer, error, again); }, Qt::QueuedConnection);
+  });
+
+  pump(name);
+}
+
+// returns why the file isn't in place, and whether another attempt may help
+QString DownloadScheduler::store(Transfer *transfer, bool &again) {
+  auto &download = transfer->download;
+  QString error = transfer->error;
+
+  if (error.isNull() && !transfer->ioError.isNull()) {
+    error = transfer->ioError;
+    again = true;
+    discard(transfer);
+  } else if (!error.isNull()) {
+    // the retry picks up wherever this one left off
+    if (transfer->resumable && transfer->transient) {
+      saveSidecar(transfer, transfer->chunks);
+      transfer->file.close();
+    } else {
+      discard(transfer);
+    }
+    again = true;
+  } else if (!verify(transfer, error)) {
+    discard(transfer);
+    again = true;
+  } else {
+    transfer->file.close();
+    if (replaceFile(transfer->file.fileName(), download.path)) {
+      QFile::remove(transfer->sidecar);
+
+      // so whoever indexes it doesn't have to stat it again
+      QFileInfo file(download.path);
+      download.size = file.size();
+      download.mtime = file.lastModified().toMSecsSinceEpoch();
+    } else {
+      discard(transfer);
+      error = "couldn't move " + download.path + " into place";
+    }
+  }
+
+  return error;
+}
+
+void DownloadScheduler::stored(Transfer *transfer, const QString &error,
+                               bool again) {
+  auto download = transfer->download;
+  // only network errors can tell a lost cause apart
+  bool transient = transfer->error.isNull() || transfer->transient;
+  delete transfer;
+
+  if (error.isNull())
+    settle(download);
+  else if (again)
+    retry(download, error, transient);
+  else
+    settle(download, error);
+}
+
+bool DownloadScheduler::verify(Transfer *transfer, QString &error) {
+  auto &download = transfer->download;
+
+  // size first, it's cheap
+  qint64 received = 0;
+  for (auto &chunk : transfer->chunks) {
+    if (chunk.end >= 0 && chunk.written != chunk.end - chunk.start) {
+      error = QString("range at %1 is incomplete").arg(chunk.start);
+      return false;
+    }
+    received += chunk.written;
+  }
+
+  if (download.size >= 0 && received != download.size) {
+    error = QString("expected %1 bytes, got %2")
+                .arg(download.size)
+                .arg(received);
+    return false;
+  }
+
+  if (download.sha1.isEmpty())
+    return true;
+
+  // ranges came in side by side, so those are read back once at the end
+  if (!transfer->streaming) {
+    transfer->file.flush();
+    if (!hashFile(transfer->file, received, transfer->hash)) {
+      error = transfer->file.errorString();
+      return false;
+    }
+  }
+
+  if (transfer->hash.result() != download.sha1) {
+    error = "checksum mismatch";
+    return false;
+  }
+
+  return true;
+}
+
+// whatever the sidecar claims has to be on disk already, which the worker
+// gets to in order
+void DownloadScheduler::checkpoint(Transfer *transfer) {
+  auto chunks = transfer->chunks;
+  io->post(transfer->worker, [=]() { saveSidecar(transfer, chunks); });
+  transfer->unsaved = 0;
+}
+
+void DownloadScheduler::saveSidecar(Transfer *transfer,
+                                    const QVector<Chunk> &chunks) {
+  auto &download = transfer->download;
+  transfer->file.flush();
+
+  QJsonArray ranges;
+  for (auto &chunk : chunks)
+    ranges << QJsonArray{chunk.start, chunk.end, chunk.written};
+
+  QJsonObject data{
+      {"sha1", QString::fromLatin1(download.sha1.toHex())},
+      {"size", download.size},
+      {"chunks", ranges},
+  };
+
+  QSaveFile file(transfer->sidecar);
+  if (file.open(QIODevice::WriteOnly)) {
+    file.write(QJsonDocument(data).toJson(QJsonDocument::Compact));
+    file.commit();
+  }
+}
+
+void DownloadScheduler::discard(Transfer *transfer) {
+  transfer->file.remove();
+  QFile::remove(transfer->sidecar);
+}
+
+void DownloadScheduler::retry(Download download, const QString &error,
+                              bool transient) {
+  auto attempts = settings.value("downloads/maxAttempts", MAX_ATTEMPTS).toInt();
+
+  // with mirrors left to try, there's no point in hammering this one
+  if (!download.mirrors.isEmpty())
+    attempts = 1;
+
+  if (!transient || ++download.attempts >= attempts) {
+    if (download.mirrors.isEmpty()) {
+      settle(download, error);
+      return;
+    }
+
+    qDebug() << download.url << "failed, trying the next mirror";
+    download.url = download.mirrors.takeFirst();
+    download.attempts = 0;
+    schedule(download);
+    return;
+  }
+
+  // exponential backoff, with some jitter so retries don't arrive in lockstep
+  int delay = RETRY_BASE_MS << (download.attempts - 1);
+  delay += QRandomGenerator::global()->bounded(delay / 2 + 1);
+
+  metrics.retries++;
+  QTimer::singleShot(delay, this, [=]() { schedule(download); });
+}
+
+void DownloadScheduler::settle(const Download &download, const QString &error) {
+  outstanding[int(download.priority)]--;
+  pending.remove(download.path);
+
+  // the last critical one lets everything that was held back go
+  if (download.priority == Priority::Critical &&
+      outstanding[int(Priority::Critical)] == 0)
+    for (auto &name : hosts.keys())
+      pump(name);
+
+  metrics.bytesSettled += qMax<qint64>(download.size, 0);
+  if (error.isNull())
+    metrics.completed++;
+  else
+    metrics.failed++;
+
+  if (error.isNull()) {
+    for (auto &callback : finished)
+      callback(download);
+  } else {
+    for (auto &callback : failed)
+      callback(download, error);
+  }
+}
+
+// verified files under assets/objects, so a warm launch can skip stat()ing
+// every single one. stored as a flat array of fixed-size records
+class ObjectIndex {
+public:
+  struct Entry {
+    qint64 size;
+    qint64 mtime;
+  };
+
+  void load(const QString &path);
+  const QString &file() const { return path; }
+  bool save();
+  bool contains(const QByteArray &sha1, qint64 size) const;
+  void insert(const QByteArray &sha1, const QFileInfo &file);
+  void insert(const QByteArray &sha1, qint64 size, qint64 mtime);
+  void remove(const QByteArray &sha1);
+  void rescan(const QString &objectsDir, QObject *context,
+              std::function<void(QVector<QByteArray>)> callback) const;
+
+private:
+  QString path;
+  QHash<QByteArray, Entry> entries;
+  bool dirty = false;
+};
+
+void ObjectIndex::load(const QString &path) {
+  this->path = path;
+  entries.clear();
+
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+
+  auto data = file.readAll();
+  QDataStream stream(data);
+  quint32 magic, version, count;
+  stream >> magic >> version >> count;
+  if (magic != INDEX_MAGIC || version != INDEX_VERSION)
+    return;
+
+  // a hash and two qint64 each, so a corrupt count can't be believed
+  const int record = 20 + 2 * sizeof(qint64);
+  if (count > quint32(data.size() / record))
+    return;
+
+  entries.reserve(count);
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+    QByteArray sha1(20, Qt::Uninitialized);
+    Entry entry;
+    stream.readRawData(sha1.data(), sha1.size());
+    stream >> entry.size >> entry.mtime;
+    entries[sha1] = entry;
+  }
+
+  // a truncated index is as good as no index
+  if (stream.status() != QDataStream::Ok)
+    entries.clear();
+}
+
+bool ObjectIndex::save() {
+  if (!dirty)
+    return true;
+
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  QDataStream stream(&file);
+  stream << INDEX_MAGIC << INDEX_VERSION << quint32(entries.size());
+  for (auto it = entries.constBegin(); it != entries.constEnd(); it++) {
+    stream.writeRawData(it.key().constData(), it.key().size());
+    stream << it->size << it->mtime;
+  }
+
+  dirty = !file.commit();
+  return !dirty;
+}
+
+bool ObjectIndex::contains(const QByteArray &sha1, qint64 size) const {
+  auto it = entries.constFind(sha1);
+  return it != entries.constEnd() && it->size == size;
+}
+
+void ObjectIndex::insert(const QByteArray &sha1, const QFileInfo &file) {
+  insert(sha1, file.size(), file.lastModified().toMSecsSinceEpoch());
+}
+
+void ObjectIndex::insert(const QByteArray &sha1, qint64 size, qint64 mtime) {
+  entries[sha1] = {size, mtime};
+  dirty = true;
+}
+
+void ObjectIndex::remove(const QByteArray &sha1) {
+  dirty |= entries.remove(sha1) > 0;
+}
+
+void ObjectIndex::rescan(const QString &objectsDir, QObject *context,
+                         std::function<void(QVector<QByteArray>)> callback)
+    const {
+  // stat everything on a worker, and report back whatever went missing or
+  // was touched since it was verified
+  auto entries = this->entries;
+  QThreadPool::globalInstance()->start([=]() {
+    QVector<QByteArray> stale;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); it++) {
+      auto hash = QString::fromLatin1(it.key().toHex());
+      QFileInfo file(objectsDir + "/" + hash.left(2) + "/" + hash);
+      if (!file.exists() || file.size() != it->size ||
+          file.lastModified().toMSecsSinceEpoch() != it->mtime)
+        stale << it.key();
+    }
+
+    QMetaObject::invokeMethod(
+        context, [=]() { callback(stale); }, Qt::QueuedConnection);
+  });
+}
+
+// one per process. every launcher records into and trusts the same index,
+// so nothing one of them learns gets lost to another's save
+ObjectIndex &objectIndex(const QString &path) {
+  static ObjectIndex index;
+  if (index.file() != path)
+    index.load(path);
+  return index;
+}
+
+struct ZipEntry {
+  QString name;
+  quint16 version; // needed to extract
+  quint16 flags;
+  quint16 method;
+  quint16 time;
+  quint16 date;
+  quint32 crc;
+  quint32 compressedSize;
+  quint32 size;
+  quint32 offset; // of the local header
+  QByteArray extra; // the central one, the local one may differ
+};
+
+// where the central directory is, from the end of central directory record
+struct ZipDirectory {
+  quint16 count;
+  quint32 length;
+  quint32 offset;
+};
+
+// just enough zip to get files out of jars: no zip64, no encryption
+class ZipReader {
+public:
+  explicit ZipReader(const QString &path) : file(path) {}
+  bool open();
+  bool read(const ZipEntry &entry, QByteArray &data);
+  qint64 dataOffset(const ZipEntry &entry);
+  const QVector<ZipEntry> &entries() const { return directory; }
+
+  // for directories that aren't in a local file
+  static bool findDirectory(const QByteArray &tail, ZipDirectory &found);
+  static bool parseDirectory(const QByteArray &data, int count,
+                             QVector<ZipEntry> &entries);
+
+private:
+  QFile file;
+  QVector<ZipEntry> directory;
+};
+
+quint16 readLE16(const char *data) {
+  return qFromLittleEndian<quint16>(data);
+}
+
+quint32 readLE32(const char *data) {
+  return qFromLittleEndian<quint32>(data);
+}
+
+// the end of central directory record is somewhere in the last 64k, since it
+// may be followed by a comment
+bool ZipReader::findDirectory(const QByteArray &tail, ZipDirectory &found) {
+  auto end = tail.lastIndexOf("PK\x05\x06");
+  if (end < 0 || end + 22 > tail.size())
+    return false;
+
+  found.count = readLE16(tail.constData() + end + 10);
+  found.length = readLE32(tail.constData() + end + 12);
+  found.offset = readLE32(tail.constData() + end + 16);
+  return true;
+}
+
+bool ZipReader::parseDirectory(const QByteArray &data, int count,
+                               QVector<ZipEntry> &entries) {
+  for (int pos = 0; pos + 46 <= data.size();) {
+    auto header = data.constData() + pos;
+    if (readLE32(header) != 0x02014b50)
+      break;
+
+    auto nameLength = readLE16(header + 28);
+    auto extraLength = readLE16(header + 30);
+    if (pos + 46 + nameLength + extraLength > data.size())
+      break;
+
+    ZipEntry entry;
+    entry.name = QString::fromUtf8(header + 46, nameLength);
+    entry.version = readLE16(header + 6);
+    entry.flags = readLE16(header + 8);
+    entry.method = readLE16(header + 10);
+    entry.time = readLE16(header + 12);
+    entry.date = readLE16(header + 14);
+    entry.crc = readLE32(header + 16);
+    entry.compressedSize = readLE32(header + 20);
+    entry.size = readLE32(header + 24);
+    entry.offset = readLE32(header + 42);
+    entry.extra = QByteArray(header + 46 + nameLength, extraLength);
+    entries << entry;
+
+    pos += 46 + nameLength + extraLength + readLE16(header + 32);
+  }
+
+  return entries.size() == count;
+}
+
+bool ZipReader::open() {
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  auto tailSize = qMin<qint64>(file.size(), 0xffff + 22);
+  file.seek(file.size() - tailSize);
+  ZipDirectory found;
+  if (!findDirectory(file.read(tailSize), found))
+    return false;
+
+  file.seek(found.offset);
+  return parseDirectory(file.read(found.length), found.count, directory);
+}
+
+// the local header can have a different extra field from the central one
+qint64 ZipReader::dataOffset(const ZipEntry &entry) {
+  file.seek(entry.offset);
+  auto header = file.read(30);
+  if (header.size() != 30 || readLE32(header.constData()) != 0x04034b50)
+    return -1;
+
+  return entry.offset + 30 + readLE16(header.constData() + 26) +
+         readLE16(header.constData() + 28);
+}
+
+bool ZipReader::read(const ZipEntry &entry, QByteArray &data) {
+  auto offset = dataOffset(entry);
+  if (offset < 0)
+    return false;
+
+  file.seek(offset);
+  auto compressed = file.read(entry.compressedSize);
+  if (compressed.size() != qint64(entry.compressedSize))
+    return false;
+
+  if (entry.method == 0) {
+    data = compressed;
+  } else if (entry.method == 8) {
+    data = QByteArray(entry.size, Qt::Uninitialized);
+
+    z_stream stream = {};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+      return false;
+
+    stream.next_in = (Bytef *)compressed.data();
+    stream.avail_in = compressed.size();
+    stream.next_out = (Bytef *)data.data();
+    stream.avail_out = data.size();
+    auto result = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+
+    if (result != Z_STREAM_END || stream.total_out != entry.size)
+      return false;
+  } else {
+    return false;
+  }
+
+  auto crc = crc32(0, (const Bytef *)data.constData(), data.size());
+  return crc == entry.crc;
+}
+
+bool isSharedLibrary(const QString &name) {
+  for (auto suffix : {".so", ".dll", ".dylib", ".jnilib"})
+    if (name.endsWith(suffix))
+      return true;
+
+  return false;
+}
+
+// flattens whatever shared libraries the jar has into dir, which is only
+// marked as done once everything is there
+bool extractNatives(const QString &jar, const QString &dir,
+                    const QStringList &exclude) {
+  ZipReader zip(jar);
+  if (!zip.open())
+    return false;
+
+  QDir(dir).removeRecursively();
+  QDir(dir).mkpath(".");
+
+  for (auto &entry : zip.entries()) {
+    auto name = QFileInfo(entry.name).fileName();
+    if (entry.name.endsWith('/') || !isSharedLibrary(name))
+      continue;
+
+    bool excluded = false;
+    for (auto &prefix : exclude)
+      excluded |= entry.name.startsWith(prefix);
+    if (excluded)
+      continue;
+
+    QByteArray data;
+    QSaveFile file(dir + "/" + name);
+    if (!zip.read(entry, data) || !file.open(QIODevice::WriteOnly))
+      return false;
+
+    file.write(data);
+    if (!file.commit())
+      return false;
+  }
+
+  return QFile(dir + "/.extracted").open(QIODevice::WriteOnly);
+}
+
+// rebuilds a client jar from another version's, fetching only the entries
+// that changed. those and the central directory come down in a few ranges,
+// everything else is copied over with local headers made from the central
+// ones. the result has to hash to what the version says, or it's dropped
+class JarPatcher : QObject {
+public:
+  JarPatcher(const Download &download, const QStringList &bases,
+             QObject *parent);
+  void start();
+
+  std::function<void(bool)> done; // false if it has to be fetched whole
+
+private:
+  struct Range {
+    qint64 start;
+    qint64 end;
+    QByteArray data;
+  };
+
+  struct Copy {
+    ZipEntry entry;
+    qint64 source;       // of the data in the base jar
+    qint64 headerLength; // of the local header in the new one
+  };
+
+  void fetch(qint64 start, qint64 end,
+             std::function<void(const QByteArray &)> callback);
+  void directoryFetched(const QByteArray &tail, qint64 tailStart);
+  void plan(QVector<ZipEntry> entries);
+  void addRange(qint64 start, qint64 end);
+  void fetchRanges();
+  bool write(const QString &path);
+  void finish(bool ok);
+  void fail(const QString &why);
+
+  Download download;
+  QStringList bases;
+  QString base;
+  QNetworkAccessManager *client;
+  ZipDirectory directory;
+  QByteArray directoryData; // everything from the directory to the end
+  QVector<Range> ranges;
+  QVector<Copy> copies;
+  qint64 fetched = 0;
+  qint64 reused = 0;
+  int waiting = 0;
+  bool failed = false;
+};
+
+JarPatcher::JarPatcher(const Download &download, const QStringList &bases,
+                       QObject *parent)
+    : QObject(parent), download(download), bases(bases) {
+  client = new QNetworkAccessManager(this);
+}
+
+void JarPatcher::start() {
+  auto tailStart = qMax<qint64>(0, download.size - (0xffff + 22));
+  fetch(tailStart, download.size, [=](const QByteArray &tail) {
+    directoryFetched(tail, tailStart);
+  });
+}
+
+void JarPatcher::fetch(qint64 start, qint64 end,
+                       std::function<void(const QByteArray &)> callback) {
+  auto request = QNetworkRequest(download.url);
+  request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+  request.setRawHeader(
+      "Range", QString("bytes=%1-%2").arg(start).arg(end - 1).toLatin1());
+
+  auto reply = client->get(request);
+  connect(reply, &QNetworkReply::finished, this, [=]() {
+    reply->deleteLater();
+    if (failed)
+      return;
+
+    // a server ignoring the range sends all of it, which is no use here
+    auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    auto data = reply->readAll();
+    if (reply->error() != QNetworkReply::NoError || status.toInt() != 206 ||
+        data.size() != end - start) {
+      fail("range request failed: " + reply->errorString());
+      return;
+    }
+
+    fetched += data.size();
+    callback(data);
+  });
+}
+
+void JarPatcher::directoryFetched(const QByteArray &tail, qint64 tailStart) {
+  if (!ZipReader::findDirectory(tail, directory) ||
+      directory.count == 0xffff ||
+      directory.offset + qint64(directory.length) > download.size) {
+    fail("no central directory");
+    return;
+  }
+
+  auto parse = [=](const QByteArray &data) {
+    directoryData = data;
+    QVector<ZipEntry> entries;
+    if (!ZipReader::parseDirectory(data.left(directory.length),
+                                   directory.count, entries) ||
+        entries.isEmpty()) {
+      fail("broken central directory");
+      return;
+    }
+    plan(entries);
+  };
+
+  if (directory.offset >= tailStart)
+    parse(tail.mid(directory.offset - tailStart));
+  else
+    fetch(directory.offset, tailStart,
+          [=](const QByteArray &head) { parse(head + tail); });
+}
+
+bool sameEntry(const ZipEntry &a, const ZipEntry &b) {
+  // data descriptors sit between entries, so those can't be placed
+  return a.method == b.method && a.crc == b.crc && a.size == b.size &&
+         a.compressedSize == b.compressedSize && !(a.flags & 8) &&
+         !(b.flags & 8);
+}
+
+void JarPatcher::plan(QVector<ZipEntry> entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](auto &a, auto &b) { return a.offset < b.offset; });
+
+  // entries are matched by name, the base with the most bytes to spare wins
+  QHash<QString, ZipEntry> matches;
+  qint64 best = 0;
+  for (auto &path : bases) {
+    ZipReader zip(path);
+    if (!zip.open())
+      continue;
+
+    QHash<QString, ZipEntry> found;
+    qint64 bytes = 0;
+    for (auto &entry : zip.entries())
+      found[entry.name] = entry;
+    for (auto &entry : entries) {
+      auto it = found.constFind(entry.name);
+      if (it != found.constEnd() && sameEntry(*it, entry))
+        bytes += entry.compressedSize;
+    }
+
+    if (bytes > best) {
+      best = bytes;
+      base = path;
+      matches = found;
+    }
+  }
+
+  if (best < download.size / 2) {
+    fail("too little in common with any installed jar");
+    return;
+  }
+
+  ZipReader zip(base);
+  zip.open();
+  if (entries[0].offset > 0)
+    addRange(0, entries[0].offset);
+
+  for (int i = 0; i < entries.size(); i++) {
+    auto &entry = entries[i];
+    qint64 next = i + 1 < entries.size() ? entries[i + 1].offset
+                                         : qint64(directory.offset);
+
+    // the local header is whatever comes before the data. it's rebuilt from
+    // the central one, with or without that one's extra field
+    auto headerLength = next - entry.compressedSize - entry.offset;
+    auto nameLength = entry.name.toUtf8().size();
+    auto old = matches.constFind(entry.name);
+    bool reusable = old != matches.constEnd() && sameEntry(*old, entry) &&
+                    (headerLength == 30 + nameLength ||
+                     headerLength == 30 + nameLength + entry.extra.size());
+    auto source = reusable ? zip.dataOffset(*old) : -1;
+
+    if (source < 0)
+      addRange(entry.offset, next);
+    else
+      copies << Copy{entry, source, headerLength};
+  }
+
+  // joining the two closest until there are few enough requests
+  while (ranges.size() > MAX_DELTA_RANGES) {
+    int closest = 0;
+    for (int i = 1; i + 1 < ranges.size(); i++)
+      if (ranges[i + 1].start - ranges[i].end <
+          ranges[closest + 1].start - ranges[closest].end)
+        closest = i;
+
+    ranges[closest].end = ranges[closest + 1].end;
+    ranges.remove(closest + 1);
+  }
+
+  // whatever the ranges ended up covering doesn't need copying
+  QVector<Copy> kept;
+  int range = 0;
+  for (auto &copy : copies) {
+    while (range < ranges.size() && ranges[range].end <= copy.entry.offset)
+      range++;
+    if (range < ranges.size() && ranges[range].start <= copy.entry.offset)
+      continue;
+
+    kept << copy;
+    reused += copy.entry.compressedSize;
+  }
+  copies = kept;
+
+  fetchRanges();
+}
+
+void JarPatcher::addRange(qint64 start, qint64 end) {
+  if (!ranges.isEmpty() && start - ranges.last().end < DELTA_MERGE_GAP)
+    ranges.last().end = end;
+  else
+    ranges << Range{start, end, {}};
+}
+
+void JarPatcher::fetchRanges() {
+  waiting = ranges.size();
+  if (waiting == 0)
+    finish(true);
+
+  for (int i = 0; i < ranges.size(); i++)
+    fetch(ranges[i].start, ranges[i].end, [=](const QByteArray &data) {
+      ranges[i].data = data;
+      if (--waiting == 0)
+        finish(true);
+    });
+}
+
+// on a worker, everything it reads is left alone until it's done
+bool JarPatcher::write(const QString &path) {
+  QFile from(base);
+  QFile to(path);
+  if (!directories().mkpath(parentDir(path)) ||
+      !from.open(QIODevice::ReadOnly) ||
+      !to.open(QIODevice::ReadWrite | QIODevice::Truncate))
+    return false;
+
+  for (auto &copy : copies) {
+    auto &entry = copy.entry;
+    auto name = entry.name.toUtf8();
+    auto extra =
+        copy.headerLength > 30 + name.size() ? entry.extra : QByteArray();
+
+    QByteArray header(30, Qt::Uninitialized);
+    auto data = header.data();
+    qToLittleEndian<quint32>(0x04034b50, data);
+    qToLittleEndian<quint16>(entry.version, data + 4);
+    qToLittleEndian<quint16>(entry.flags, data + 6);
+    qToLittleEndian<quint16>(entry.method, data + 8);
+    qToLittleEndian<quint16>(entry.time, data + 10);
+    qToLittleEndian<quint16>(entry.date, data + 12);
+    qToLittleEndian<quint32>(entry.crc, data + 14);
+    qToLittleEndian<quint32>(entry.compressedSize, data + 18);
+    qToLittleEndian<quint32>(entry.size, data + 22);
+    qToLittleEndian<quint16>(name.size(), data + 26);
+    qToLittleEndian<quint16>(extra.size(), data + 28);
+
+    from.seek(copy.source);
+    auto compressed = from.read(entry.compressedSize);
+    if (compressed.size() != qint64(entry.compressedSize) ||
+        !to.seek(entry.offset) || to.write(header + name + extra) < 0 ||
+        to.write(compressed) != compressed.size())
+      return false;
+  }
+
+  for (auto &range : ranges)
+    if (!to.seek(range.start) || to.write(range.data) != range.data.size())
+      return false;
+  if (!to.seek(directory.offset) ||
+      to.write(directoryData) != directoryData.size())
+    return false;
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  return to.size() == download.size && hashFile(to, download.size, hash) &&
+         hash.result() == download.sha1;
+}
+
+void JarPatcher::finish(bool ok) {
+  if (!ok) {
+    fail("couldn't fetch what changed");
+    return;
+  }
+
+  auto path = download.path + ".delta";
+  QThreadPool::globalInstance()->start([=]() {
+    bool written = write(path);
+    QMetaObject::invokeMethod(
+        this,
+        [=]() mutable {
+          if (written) {
+            QFile::remove(download.path);
+            written = QFile::rename(path, download.path);
+          }
+          if (!written) {
+            QFile::remove(path);
+            fail("patched jar doesn't check out");
+            return;
+          }
+
+          qDebug() << "patched" << download.path << "from" << base << "with"
+                   << fetched << "bytes fetched," << reused << "reused";
+          done(true);
+          deleteLater();
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+void JarPatcher::fail(const QString &why) {
+  if (failed)
+    return;
+
+  failed = true;
+  qDebug() << "not patching" << download.path << why;
+  done(false);
+  deleteLater();
+}
+
+QString objectPath(const QString &dir, const QByteArray &sha1) {
+  auto hash = QString::fromLatin1(sha1.toHex());
+  return dir + "/" + hash.left(2) + "/" + hash;
+}
+
+// drops whatever no installed version refers to anymore: objects missing
+// from every asset index, and client jars no version was materialized from.
+// blocks, so run it on a worker. returns the objects that were removed
+QVector<QByteArray> collectGarbage(const QString &assetsDir,
+                                   const QString &versionsDir,
+                                   const QString &storeDir) {
+  QSet<QByteArray> referenced;
+  QDirIterator indexes(assetsDir + "/indexes", {"*.json"}, QDir::Files);
+  while (indexes.hasNext()) {
+    QFile file(indexes.next());
+    if (!file.open(QIODevice::ReadOnly))
+      continue;
+
+    auto index = AssetIndex::fromJson(file.readAll());
+    if (index.objects.empty()) {
+      // can't tell what it needs, so better not touch anything
+      qWarning() << "unreadable asset index" << file.fileName();
+      return {};
+    }
+
+    for (auto &obj : index.objects)
+      referenced << obj.sha1();
+  }
+
+  QDirIterator versions(versionsDir, {"client.sha1"}, QDir::Files,
+                        QDirIterator::Subdirectories);
+  while (versions.hasNext()) {
+    QFile file(versions.next());
+    if (file.open(QIODevice::ReadOnly))
+      referenced << QByteArray::fromHex(file.readAll().trimmed());
+  }
+
+  QVector<QByteArray> removed;
+  qint64 freed = 0;
+  for (auto dir : {assetsDir + "/objects", storeDir}) {
+    QDirIterator it(dir, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+      it.next();
+      auto sha1 = QByteArray::fromHex(it.fileName().toLatin1());
+      if (sha1.size() != 20 || referenced.contains(sha1))
+        continue;
+
+      auto size = it.fileInfo().size();
+      if (QFile::remove(it.filePath())) {
+        removed << sha1;
+        freed += size;
+      }
+    }
+  }
+
+  qDebug() << "collected" << removed.size() << "files," << freed << "bytes";
+  return removed;
+}
+
+// in bytes, or 0 if we can't tell
+qint64 systemMemory() {
+#if defined(Q_OS_WIN)
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  return GlobalMemoryStatusEx(&status) ? status.ullTotalPhys : 0;
+#elif defined(Q_OS_MACOS)
+  qint64 size = 0;
+  auto length = sizeof(size);
+  return sysctlbyname("hw.memsize", &size, &length, nullptr, 0) == 0 ? size
+                                                                      : 0;
+#else
+  auto pages = sysconf(_SC_PHYS_PAGES);
+  auto pageSize = sysconf(_SC_PAGE_SIZE);
+  return pages > 0 && pageSize > 0 ? qint64(pages) * pageSize : 0;
+#endif
+}
+
+enum class LogLevel { Trace, Debug, Info, Warn, Error, Fatal };
+
+LogLevel logLevel(const QByteArray &name) {
+  static const QHash<QByteArray, LogLevel> levels{
+      {"TRACE", LogLevel::Trace}, {"DEBUG", LogLevel::Debug},
+      {"INFO", LogLevel::Info},   {"WARN", LogLevel::Warn},
+      {"ERROR", LogLevel::Error}, {"FATAL", LogLevel::Fatal}};
+  return levels.value(name, LogLevel::Info);
+}
+
+const char *logLevelName(LogLevel level) {
+  static const char *names[] = {"TRACE", "DEBUG", "INFO",
+                                "WARN",  "ERROR", "FATAL"};
+  return names[int(level)];
+}
+
+struct LogEvent {
+  qint64 time = 0; // ms since the epoch
+  LogLevel level = LogLevel::Info;
+  QString thread;
+  QString message;
+
+  QString toString() const {
+    auto stamp = QDateTime::fromMSecsSinceEpoch(time).toString("HH:mm:ss");
+    return QString("[%1] [%2/%3]: %4")
+        .arg(stamp, thread, logLevelName(level), message);
+  }
+};
+
+// the last LOG_LINES events. older ones are overwritten in place, and every
+// event is numbered, so readers can tell how much they missed
+class LogBuffer {
+public:
+  LogBuffer() : events(LOG_LINES) {}
+
+  void push(LogEvent event) {
+    events[written++ % events.size()] = std::move(event);
+  }
+  qint64 first() const { return qMax<qint64>(0, written - events.size()); }
+  qint64 end() const { return written; }
+  const LogEvent &at(qint64 n) const { return events[n % events.size()]; }
+
+private:
+  std::vector<LogEvent> events;
+  qint64 written = 0;
+};
+
+// runs the game and keeps an eye on it. with the log4j config in place the
+// game writes its log as xml events, otherwise every line is an event. either
+// way only the tail is kept, and listeners hear about it in batches, so a
+// chatty modpack costs neither memory nor a repaint per line
+class GameProcess : QObject {
+public:
+  explicit GameProcess(QObject *parent);
+  void start(const QString &program, const QStringList &args,
+             const QString &dir);
+  const LogBuffer &log() const { return buffer; }
+
+  bool echo = false;   // copy every event to stderr, for headless launches
+  QString crashReport; // if the game said it saved one
+
+  std::function<void()> logged;    // at most every LOG_INTERVAL_MS
+  std::function<void(int)> exited; // with -1 if it crashed or never started
+
+private:
+  void read(QByteArray &pending, const QByteArray &data, LogLevel level);
+  void parseEvent(const QByteArray &xml);
+  void add(LogEvent event);
+
+  QProcess *process;
+  QTimer *notify;
+  LogBuffer buffer;
+  QByteArray out; // whatever came in past the last complete line or event
+  QByteArray err;
+};
+
+GameProcess::GameProcess(QObject *parent) : QObject(parent) {
+  process = new QProcess(this);
+  notify = new QTimer(this);
+  notify->setSingleShot(true);
+  notify->setInterval(LOG_INTERVAL_MS);
+  connect(notify, &QTimer::timeout, this, [this]() {
+    if (logged)
+      logged();
+  });
+
+  connect(process, &QProcess::readyReadStandardOutput, this, [this]() {
+    read(out, process->readAllStandardOutput(), LogLevel::Info);
+  });
+  connect(process, &QProcess::readyReadStandardError, this, [this]() {
+    read(err, process->readAllStandardError(), LogLevel::Error);
+  });
+  connect(process,
+          QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+          [this](int code, QProcess::ExitStatus status) {
+            // whatever didn't end in a newline still goes in
+            read(out, "\n", LogLevel::Info);
+            read(err, "\n", LogLevel::Error);
+            notify->stop();
+            if (logged)
+              logged();
+
+            DownloadScheduler::gameStopped();
+            if (status != QProcess::NormalExit)
+              code = -1;
+            if (code != 0)
+              qWarning() << "game exited with" << code << crashReport;
+            if (exited)
+              exited(code);
+          });
+  connect(process, &QProcess::errorOccurred, this, [this](auto error) {
+    if (error != QProcess::FailedToStart)
+      return;
+
+    DownloadScheduler::gameStopped();
+    if (exited)
+      exited(-1);
+  });
+}
+
+void GameProcess::start(const QString &program, const QStringList &args,
+                        const QString &dir) {
+  QDir(dir).mkpath(".");
+  process->setWorkingDirectory(dir);
+
+  // anything still downloading steps aside while the game runs
+  DownloadScheduler::gameStarted();
+  process->start(program, args);
+}
+
+// everything complete in pending is turned into events, and the rest kept
+// for next time. events are only cut out of the buffer once per read, it can
+// hold thousands of lines when the game gets going
+void GameProcess::read(QByteArray &pending, const QByteArray &data,
+                       LogLevel level) {
+  pending += data;
+  int pos = 0;
+  while (pos < pending.size()) {
+    if (isspace(uchar(pending[pos]))) {
+      pos++;
+      continue;
+    }
+
+    if (!qstrncmp(pending.constData() + pos, "<log4j:Event", 12)) {
+      auto end = pending.indexOf("</log4j:Event>", pos);
+      if (end >= 0) {
+        end += int(strlen("</log4j:Event>"));
+        parseEvent(pending.mid(pos, end - pos));
+        pos = end;
+        continue;
+      }
+      // a broken event shouldn't hold up everything after it
+      if (pending.size() - pos < MAX_LOG_EVENT)
+        break;
+    }
+
+    auto end = pending.indexOf('\n', pos);
+    if (end < 0 && pending.size() - pos < MAX_LOG_LINE)
+      break;
+    if (end < 0)
+      end = pending.size();
+
+    LogEvent event;
+    event.time = QDateTime::currentMSecsSinceEpoch();
+    event.level = level;
+    event.thread = level == LogLevel::Error ? "stderr" : "stdout";
+    event.message = QString::fromUtf8(
+        pending.constData() + pos, qMin(end - pos, MAX_LOG_LINE)).trimmed();
+    add(std::move(event));
+    pos = end + 1;
+  }
+
+  pending.remove(0, qMin(pos, pending.size()));
+}
+
+QByteArray xmlAttribute(const QByteArray &xml, const QByteArray &name) {
+  auto key = " " + name + "=\"";
+  auto start = xml.indexOf(key);
+  if (start < 0)
+    return {};
+  start += key.size();
+  return xml.mid(start, xml.indexOf('"', start) - start);
+}
+
+QString xmlText(const QByteArray &xml, const QByteArray &tag) {
+  auto start = xml.indexOf("<" + tag + ">");
+  if (start < 0)
+    return {};
+  start += tag.size() + 2;
+  auto text = xml.mid(start, xml.indexOf("</" + tag + ">", start) - start);
+  if (text.startsWith("<![CDATA[") && text.endsWith("]]>"))
+    text = text.mid(9, text.size() - 12);
+  return QString::fromUtf8(text.left(MAX_LOG_LINE));
+}
+
+// log4j's XMLLayout, one event at a time. attributes only ever use the five
+// standard entities
+void GameProcess::parseEvent(const QByteArray &xml) {
+  auto unescape = [](QByteArray text) {
+    return QString::fromUtf8(text.replace("&lt;", "<")
+                                 .replace("&gt;", ">")
+                                 .replace("&quot;", "\"")
+                                 .replace("&apos;", "'")
+                                 .replace("&amp;", "&"));
+  };
+
+  LogEvent event;
+  event.time = xmlAttribute(xml, "timestamp").toLongLong();
+  event.level = logLevel(xmlAttribute(xml, "level"));
+  event.thread = unescape(xmlAttribute(xml, "thread"));
+  event.message = xmlText(xml, "log4j:Message");
+  auto throwable = xmlText(xml, "log4j:Throwable");
+  if (!throwable.isEmpty())
+    event.message += "\n" + throwable.trimmed();
+  add(std::move(event));
+}
+
+void GameProcess::add(LogEvent event) {
+  if (event.message.isEmpty())
+    return;
+
+  // the same marker the official launcher picks the path out with
+  const QString crashed = "#@!@# Game crashed! Crash report saved to: #@!@# ";
+  auto at = event.message.indexOf(crashed);
+  if (at >= 0)
+    crashReport = event.message.mid(at + crashed.size()).trimmed();
+
+  if (echo) {
+    fprintf(stderr, "%s\n", qPrintable(event.toString()));
+    fflush(stderr);
+  }
+
+  buffer.push(std::move(event));
+  if (!notify->isActive())
+    notify->start();
+}
+
+class Launcher : QObject {
+public:
+  Launcher(const VersionInfo &version, const AssetIndex &assets,
+           const JavaRuntime &runtime, DownloadScheduler *shared = nullptr);
+  ~Launcher();
+  void launchGame();
+  void install();
+  void repair();
+  bool downloading() const { return patching || downloads->remaining() > 0; }
+  DownloadMetrics &metrics() { return downloads->metrics; }
+  void sweep(std::function<void()> callback = {});
+
+  std::function<void()> settled; // every download either went in or failed
+  std::function<void(int)> exited; // with -1 if the game never got going
+  std::function<void(GameProcess *)> spawned;
+
+private:
+  void classpathReady();
+  void downloadsSettled();
+  void dumpMetrics();
+  void extractNatives(std::function<void()> callback);
+  void materializeAssets(std::function<void()> callback);
+  void startGame();
+  void prepareRuntime();
+  QString javaPath() const;
+  void downloadFiles();
+  void createBuckets();
+  bool haveAsset(const Download &download);
+  bool downloadAsset(const Download &download);
+  bool patchClient(const Download &download);
+  bool intact(const Download &download);
+  bool linkShared(const Download &download);
+  bool materializeClient();
+  void referenceClient();
+  void rescanObjects();
+  QVariant profile(const QString &key, const QVariant &fallback = {}) const;
+  QString classpathKey() const;
+  QString classpath() const;
+  QString classpathFile() const;
+  void heapArgs();
+  void gcArgs();
+  void sharingArgs();
+  QString expand(const QString &arg) const;
+  void jvmArgs();
+  void gameArgs();
+
+  // launchers in this process with downloads still going
+  static QSet<Launcher *> &installing();
+
+  VersionInfo version;
+  AssetIndex assets;
+  JavaRuntime runtime;
+  DownloadScheduler *downloads;
+  bool batched; // on a scheduler shared with other launchers
+  ObjectIndex &store;
+  QHash<QByteArray, Download> indexed;
+  QStringList args;
+  QStringList nativeDirs;
+  int extracting = 0;
+  int materializing = 0;
+  bool launching = false;
+  bool verifying = false;
+  bool started = false;
+  bool incomplete = false;
+  bool incompleteAssets = false;
+  bool patching = false;
+  qint64 criticalTrace = -1; // spans from install() on
+  qint64 settledTrace = -1;
+
+  QDir dataDir;
+  QString sharedDir;
+  QStringList resourceEndpoints;
+  QStringList libraryEndpoints;
+  QStringList clientEndpoints;
+  QString assetsDir;
+  QString virtualDir;
+  QString librariesDir;
+  QString gameDir;
+  QString versionDir;
+  QString nativesDir;
+  QString runtimeDir;
+  QString storeDir;
+  QString clientBlob;
+  QString logConfig;
+};
+
+Launcher::Launcher(const VersionInfo &version, const AssetIndex &assets,
+                   const JavaRuntime &runtime, DownloadScheduler *shared)
+    : version(version), assets(assets), runtime(runtime), downloads(shared),
+      batched(shared),
+      store(objectIndex(getDataDirectory().filePath("objects.idx"))) {
+  if (!downloads)
+    downloads = new DownloadScheduler(this);
+
+  QSettings settings;
+  dataDir = getDataDirectory();
+  assetsDir = settings.value("store/assetsDir", dataDir.filePath("assets"))
+                  .toString();
+  librariesDir =
+      settings.value("store/librariesDir", dataDir.filePath("libraries"))
+          .toString();
+  sharedDir = settings.value("store/shared").toString();
+
+  // the client jar and libraries are only ever mirrored, their own urls are
+  // the official ones
+  resourceEndpoints = endpoints("mirrors/resources", RESOURCES_ENDPOINT);
+  libraryEndpoints = endpoints("mirrors/libraries", {});
+  clientEndpoints = endpoints("mirrors/piston", {});
+  virtualDir = assetsDir + "/virtual/" + version.assets;
+  gameDir = dataDir.filePath("instances/" + version.id + "/minecraft");
+  versionDir = dataDir.filePath("versions/" + version.id);
+  nativesDir = getCacheDirectory().filePath("natives");
+  runtimeDir = dataDir.filePath("runtimes/" + runtime.component);
+  storeDir = dataDir.filePath("store");
+
+  // client jars live in the store by hash, and each version gets a clone
+  if (!version.clientJar.sha1.isEmpty())
+    clientBlob = objectPath(storeDir, version.clientJar.sha1);
+
+  // some versions want their logs as xml, for parsing what the game says
+  if (!version.logConfig.url.isEmpty() && !version.logConfig.path.isEmpty() &&
+      profile("xmlLog", true).toBool())
+    logConfig = assetsDir + "/log_configs/" + version.logConfig.path;
+}
+
+void Launcher::launchGame() {
+  // the jvm starts as soon as the classpath is in place, the remaining assets
+  // keep downloading in the background while it boots
+  launching = true;
+  install();
+  classpathReady();
+}
+
+Launcher::~Launcher() { installing().remove(this); }
+
+QSet<Launcher *> &Launcher::installing() {
+  static QSet<Launcher *> all;
+  return all;
+}
+
+void Launcher::install() {
+  installing() << this;
+  criticalTrace = settledTrace = traceStart();
+  QDir(nativesDir).mkpath(".");
+
+  downloadFiles();
+  if (!downloading())
+    downloadsSettled();
+
+  if (QSettings().value("store/rescan", false).toBool())
+    rescanObjects();
+}
+
+// like install, but whatever is already there is checked against its hash
+// as well. reads everything back, so it's anything but quick
+void Launcher::repair() {
+  verifying = true;
+  install();
+}
+
+void Launcher::classpathReady() {
+  if (!launching || started || patching ||
+      downloads->remaining(Priority::Critical) > 0)
+    return;
+
+  // the old layouts are made from every object, so they all have to be in
+  if ((assets.isVirtual || assets.mapToResources) && downloading())
+    return;
+
+  started = true;
+  traceEnd("critical downloads", criticalTrace, version.id);
+  if (incomplete) {
+    qWarning() << "classpath for" << version.id << "is incomplete, giving up";
+    if (exited)
+      exited(-1);
+    return;
+  }
+
+  {
+    TraceScope scope("prepareRuntime", runtime.component);
+    prepareRuntime();
+  }
+
+  auto start = traceStart();
+  materializeAssets([=]() {
+    traceEnd("materializeAssets", start, version.assets);
+    auto natives = traceStart();
+    extractNatives([=]() {
+      traceEnd("extractNatives", natives, version.id);
+      startGame();
+    });
+  });
+}
+
+// versions before 1.7 want their assets by name. those are linked in from
+// the objects on a few workers, skipping whatever is in place already, and
+// once a tree has been made for an index it's left alone entirely
+void Launcher::materializeAssets(std::function<void()> callback) {
+  if (!assets.isVirtual && !assets.mapToResources) {
+    callback();
+    return;
+  }
+
+  auto target = assets.mapToResources ? gameDir + "/resources" : virtualDir;
+  auto marker = target + "/.index.sha1";
+  auto sha1 = version.assetIndex.sha1.toHex();
+  QFile done(marker);
+  if (done.open(QIODevice::ReadOnly) && done.readAll() == sha1) {
+    callback();
+    return;
+  }
+
+  auto names = assets.names();
+  int count = int(assets.objects.size());
+  if (names.size() != count) {
+    qWarning() << "couldn't lay out assets for" << version.id;
+    callback();
+    return;
+  }
+
+  auto objectsDir = assetsDir + "/objects";
+  int workers = qBound(1, QThread::idealThreadCount(), 8);
+  materializing = workers;
+  for (int worker = 0; worker < workers; worker++) {
+    QThreadPool::globalInstance()->start([=]() {
+      bool ok = true;
+      for (int i = worker; i < count; i += workers) {
+        auto &obj = assets.objects[i];
+        auto path = target + "/" + names[i];
+        QFileInfo info(path);
+        if (names[i].isEmpty() || names[i].contains("..") ||
+            (info.exists() && info.size() == obj.size))
+          continue;
+
+        ok &= linkFile(objectPath(objectsDir, obj.sha1()), path);
+      }
+
+      QMetaObject::invokeMethod(
+          this,
+          [=]() {
+            if (!ok)
+              incompleteAssets = true;
+            if (--materializing > 0)
+              return;
+
+            // anything missing gets another go next time
+            QSaveFile file(marker);
+            if (!incompleteAssets && file.open(QIODevice::WriteOnly)) {
+              file.write(sha1);
+              file.commit();
+            }
+            callback();
+          },
+          Qt::QueuedConnection);
+    });
+  }
+}
+
+void Launcher::extractNatives(std::function<void()> callback) {
+  // keyed by the jar's sha1, so anything extracted before is left alone
+  for (auto &native : version.natives) {
+    auto jar = librariesDir + "/" + native.artifact.path;
+    auto key = native.artifact.sha1.isEmpty()
+                   ? QCryptographicHash::hash(jar.toUtf8(),
+                                              QCryptographicHash::Sha1)
+                   : native.artifact.sha1;
+    auto dir = nativesDir + "/" + QString::fromLatin1(key.toHex());
+    auto exclude = native.exclude;
+    nativeDirs << dir;
+
+    if (QFileInfo::exists(dir + "/.extracted"))
+      continue;
+
+    extracting++;
+    QThreadPool::globalInstance()->start([=]() {
+      bool ok = ::extractNatives(jar, dir, exclude);
+      QMetaObject::invokeMethod(
+          this,
+          [=]() {
+            if (!ok)
+              qWarning() << "failed to extract natives from" << jar;
+            if (--extracting == 0)
+              callback();
+          },
+          Qt::QueuedConnection);
+    });
+  }
+
+  if (extracting == 0)
+    callback();
+}
+
+void Launcher::startGame() {
+  jvmArgs();
+  gameArgs();
+
+  metrics().timeToLaunch = metrics().clock.elapsed();
+  dumpMetrics();
+
+  auto java = javaPath();
+  if (java.isEmpty()) {
+    qWarning() << "no java" << version.jvmVersion << "runtime to launch with";
+    if (exited)
+      exited(-1);
+    return;
+  }
+
+  auto game = new GameProcess(this);
+  game->exited = [this](int code) {
+    if (exited)
+      exited(code);
+  };
+  if (spawned)
+    spawned(game);
+
+  {
+    TraceScope scope("QProcess::start", java);
+    game->start(java, args, gameDir);
+  }
+  // the launcher's part is done, so that's worth having even if it dies
+  if (TRACING)
+    Tracer::instance().save();
+}
+
+// the scheduler only knows about plain files, the rest of the runtime's
+// layout is filled in once they're all there
+void Launcher::prepareRuntime() {
+  for (auto &dir : runtime.directories)
+    QDir(runtimeDir).mkpath(dir);
+
+  for (auto &file : runtime.files) {
+    auto path = runtimeDir + "/" + file.path;
+    if (!file.target.isEmpty()) {
+      if (!QFileInfo(path).isSymLink() && !QFile::link(file.target, path))
+        qWarning() << "couldn't link" << path;
+    } else if (file.executable) {
+      QFile(path).setPermissions(QFile::permissions(path) | QFile::ExeOwner |
+                                 QFile::ExeGroup | QFile::ExeOther);
+    }
+  }
+}
+
+QString Launcher::javaPath() const {
+  // whatever the user points us at wins, per major version or for all of them
+  QSettings settings;
+  auto key = "java/" + QString::number(version.jvmVersion);
+  auto configured = settings.value(key, settings.value("java/path"));
+  if (!configured.toString().isEmpty())
+    return configured.toString();
+
+  // on macos it's tucked away in a bundle, so go by the name
+  for (auto &file : runtime.files)
+    if (file.executable &&
+        (file.path.endsWith("bin/java") || file.path.endsWith("bin/java.exe")))
+      return runtimeDir + "/" + file.path;
+
+  qWarning() << "no managed runtime for" << version.jvmComponent
+             << "on" << runtimePlatform() << "falling back to the system's";
+  return QStandardPaths::findExecutable("java");
+}
+
+// per instance settings live under instances/<id>, anything missing there
+// comes from the jvm group all of them share
+QVariant Launcher::profile(const QString &key, const QVariant &fallback) const {
+  QSettings settings;
+  return settings.value("instances/" + version.id + "/" + key,
+                        settings.value("jvm/" + key, fallback));
+}
+
+// changes whenever the classpath or anything depending on it could
+// what goes into the classpath also changes with how we read the json, so
+// anything that makes the parsed cache go stale does the same for this
+QString Launcher::classpathKey() const {
+  auto key = QCryptographicHash::hash(
+      (version.sha1 + librariesDir + versionDir +
+       QString::number(CACHE_VERSION))
+          .toUtf8(),
+      QCryptographicHash::Sha1);
+  return key.toHex().left(16);
+}
+
+QString Launcher::classpath() const {
+  QStringList entries;
+  entries.reserve(version.libraries.size() + 1);
+  for (auto &lib : version.libraries)
+    entries << librariesDir + "/" + lib.path;
+  entries << versionDir + "/client.jar";
+
+  return entries.join(QDir::listSeparator());
+}
+
+// the classpath as a java @argfile, written once per version json. keeps us
+// clear of command line length limits, and subsequent launches don't have to
+// assemble it at all. only java 9 and up read those
+QString Launcher::classpathFile() const {
+  if (version.jvmVersion < 9 || version.sha1.isEmpty())
+    return {};
+
+  auto path = versionDir + "/classpath-" + classpathKey() + ".args";
+  if (QFileInfo::exists(path))
+    return path;
+
+  auto quoted = classpath();
+  quoted.replace("\\", "\\\\").replace("\"", "\\\"");
+
+  QSaveFile file(path);
+  QDir(versionDir).mkpath(".");
+  if (!file.open(QIODevice::WriteOnly))
+    return {};
+
+  file.write("-cp \"" + quoted.toUtf8() + "\"\n");
+  return file.commit() ? path : QString();
+}
+
+void Launcher::heapArgs() {
+  auto memory = systemMemory() / 1024 / 1024;
+  auto fallback = memory > 0 ? qBound(MIN_HEAP, memory / 4, MAX_HEAP)
+                             : MIN_HEAP * 2;
+  auto max = profile("maxHeap", fallback).toLongLong();
+  // starting at half of it saves the first few resizes during load without
+  // claiming everything up front
+  auto min = profile("minHeap", max / 2).toLongLong();
+
+  args << QString("-Xmx%1M").arg(max);
+  args << QString("-Xms%1M").arg(qMin(min, max));
+}
+
+void Launcher::gcArgs() {
+  auto gc = profile("gc", "g1").toString();
+  auto java = version.jvmVersion;
+
+  if (gc == "zgc" && java >= 15) {
+    args << "-XX:+UseZGC";
+    // generational by default from 23 on
+    if (java >= 21 && java < 23)
+      args << "-XX:+ZGenerational";
+    return;
+  }
+
+  if (gc == "shenandoah" && java >= 15) {
+    args << "-XX:+UseShenandoahGC";
+    return;
+  }
+
+  if (gc != "g1")
+    qWarning() << gc << "isn't available on java" << java << "using g1";
+
+  // what mojang's launcher has been passing for years
+  args << "-XX:+UseG1GC"
+       << "-XX:+UnlockExperimentalVMOptions"
+       << "-XX:G1NewSizePercent=20"
+       << "-XX:G1ReservePercent=20"
+       << "-XX:MaxGCPauseMillis=50"
+       << "-XX:G1HeapRegionSize=32M";
+}
+
+// a dynamic cds archive of everything the game loaded last time, so later
+// launches map the classes instead of parsing and verifying them again. the
+// jvm rejects archives from another build or classpath on its own, keying
+// them by both just keeps them from overwriting each other
+void Launcher::sharingArgs() {
+  auto java = version.jvmVersion;
+  if (java < 13 || !profile("cds", true).toBool() || version.sha1.isEmpty())
+    return;
+
+  auto path = QString("%1/classes-%2-%3.jsa")
+                  .arg(versionDir, classpathKey())
+                  .arg(runtime.version.isEmpty() ? QString::number(java)
+                                                 : runtime.version);
+
+  // dumped when the game exits, so it's only there from the second launch on
+  if (java >= 19)
+    args << "-XX:+AutoCreateSharedArchive" << "-XX:SharedArchiveFile=" + path;
+  else if (QFileInfo::exists(path))
+    args << "-XX:SharedArchiveFile=" + path;
+  else
+    args << "-XX:ArchiveClassesAtExit=" + path;
+}
+
+void Launcher::jvmArgs() {
+  TraceScope scope("jvmArgs");
+#ifdef Q_OS_MACOS
+  args << "-XstartOnFirstThread";
+#endif
+#ifdef Q_OS_WIN
+  args << "-XX:HeapDumpPath=MojangTricksIntelDriversForPerformance_javaw.exe_"
+          "minecraft.exe.heapdump";
+#endif
+#ifdef Q_PROCESSOR_X86_32
+  args << "-Xss1M";
+#endif
+  heapArgs();
+  gcArgs();
+  sharingArgs();
+  auto libraryPath = nativeDirs;
+  libraryPath << nativesDir;
+  args << "-Djava.library.path=" + libraryPath.join(QDir::listSeparator());
+  args << "-Djna.tmpdir=" + nativesDir;
+  args << "-Dorg.lwjgl.system.SharedLibraryExtractPath=" + nativesDir;
+  args << "-Dio.netty.native.workdir=" + nativesDir;
+  args << "-Dminecraft.launcher.brand=Ametrine";
+  args << "-Dminecraft.launcher.version=0.1.0";
+  // the config only goes in once it's been fetched, without it the game
+  // logs plain text, which works just as well, only less structured
+  if (!logConfig.isEmpty() && QFileInfo::exists(logConfig))
+    args << QString(version.logArgument).replace("${path}", logConfig);
+
+  // the version's own, minus what's worked out above. vanilla only lists
+  // those, with placeholders, loaders add module paths and the like
+  auto &own = version.jvmArguments;
+  for (int i = 0; i < own.size(); i++) {
+    auto &arg = own[i];
+    if (arg == "-cp" && own.value(i + 1) == "${classpath}") {
+      i++;
+      continue;
+    }
+    if (arg.contains("${natives_directory}") || arg.contains("${launcher_") ||
+        (arg.startsWith("-X") && args.contains(arg)))
+      continue;
+
+    args << expand(arg);
+  }
+
+  auto argfile = classpathFile();
+  if (argfile.isEmpty())
+    args << "-cp" << classpath();
+  else
+    args << "@" + argfile;
+  args << version.mainClass;
+}
+
+void Launcher::gameArgs() {
+  TraceScope scope("gameArgs");
+  if (!version.gameArguments.isEmpty()) {
+    for (auto &arg : version.gameArguments)
+      args << expand(arg);
+    return;
+  }
+
+  args << "--username" << USERNAME;
+  args << "--version" << version.id;
+  args << "--gameDir" << gameDir;
+  args << "--assetsDir" << (assets.isVirtual ? virtualDir : assetsDir);
+  args << "--assetIndex" << version.assets;
+  args << "--accessToken"
+       << "";
+  args << "--versionType" << version.type;
+}
+
+// fills in the ${placeholders} of version arguments. anything we don't know
+// is passed on as it is
+QString Launcher::expand(const QString &arg) const {
+  static const QRegularExpression placeholder("\\$\\{(\\w+)\\}");
+  if (!arg.contains("${"))
+    return arg;
+
+  // what an offline account's uuid is derived from, as a v3 uuid
+  auto uuid = QCryptographicHash::hash("OfflinePlayer:" + USERNAME.toUtf8(),
+                                       QCryptographicHash::Md5);
+  uuid[6] = char((uuid[6] & 0x0f) | 0x30);
+  uuid[8] = char((uuid[8] & 0x3f) | 0x80);
+
+  auto gameAssets = assets.mapToResources ? gameDir + "/resources"
+                    : assets.isVirtual    ? virtualDir
+                                          : assetsDir;
+  QHash<QString, QString> values{
+      {"auth_player_name", USERNAME},
+      {"auth_uuid", QString::fromLatin1(uuid.toHex())},
+      {"auth_access_token", ""},
+      {"auth_session", ""},
+      {"auth_xuid", ""},
+      {"clientid", ""},
+      {"user_type", "legacy"},
+      {"user_properties", "{}"},
+      {"version_name", version.id},
+      {"version_type", version.type},
+      {"game_directory", gameDir},
+      {"assets_root", assetsDir},
+      {"game_assets", gameAssets},
+      {"assets_index_name", version.assets},
+      {"library_directory", librariesDir},
+      {"classpath_separator", QDir::listSeparator()},
+      {"natives_directory", nativesDir},
+  };
+
+  QString result;
+  int last = 0;
+  auto matches = placeholder.globalMatch(arg);
+  while (matches.hasNext()) {
+    auto match = matches.next();
+    auto name = match.captured(1);
+    result += arg.midRef(last, match.capturedStart() - last);
+    if (name == "classpath")
+      result += classpath();
+    else
+      result += values.value(name, match.captured());
+    last = match.capturedEnd();
+  }
+  return result + arg.midRef(last);
+}
+
+void Launcher::downloadFiles() {
+  TraceScope scope("downloadFiles", version.id);
+  downloads->finished << [this](const Download &download) {
+    qDebug() << download.path;
+    qDebug() << downloads->remaining() << "assets left";
+
+    if (download.path == clientBlob && !materializeClient())
+      incomplete = true;
+
+    // only objects go in the index, the log config isn't one. the worker
+    // already looked at the file, so this doesn't go to the disk
+    if (download.priority == Priority::Critical)
+      classpathReady();
+    else if (download.path != logConfig)
+      store.insert(download.sha1, download.size, download.mtime);
+
+    if (!downloading())
+      downloadsSettled();
+  };
+  downloads->failed << [this](const Download &download, const QString &error) {
+    qWarning() << "failed to download" << download.url << error;
+
+    if (download.priority == Priority::Critical) {
+      incomplete = true;
+      classpathReady();
+    }
+
+    if (!downloading())
+      downloadsSettled();
+  };
+
+  auto client = version.clientJar;
+  auto clientPath = versionDir + "/client.jar";
+  QFileInfo clientInfo(clientPath);
+  if (!verifying && clientInfo.exists() && clientInfo.size() == client.size) {
+    metrics().cacheHits++;
+  } else {
+    auto clientUrls =
+        mirrored(clientEndpoints, QUrl(client.url).path().mid(1));
+    clientUrls << QUrl(client.url);
+    Download clientJar{clientUrls.takeFirst(),
+                       clientBlob.isEmpty() ? clientPath : clientBlob,
+                       Priority::Critical, client.sha1, client.size};
+    clientJar.mirrors = clientUrls;
+
+    // a sweep going on meanwhile has to know we want it, before it's there
+    if (!clientBlob.isEmpty())
+      referenceClient();
+
+    // another version or instance may have fetched the same jar already, or
+    // one close enough to patch it together from
+    if (haveAsset(clientJar)) {
+      if (!clientBlob.isEmpty())
+        materializeClient();
+    } else if (!patchClient(clientJar)) {
+      downloads->enqueue(clientJar);
+    }
+  }
+
+  // the game does fine without it, so it's not worth holding the launch for
+  if (!logConfig.isEmpty()) {
+    auto config = version.logConfig;
+    downloadAsset(Download{QUrl(config.url), logConfig, Priority::Normal,
+                           config.sha1, config.size});
+  }
+
+  // the jvm can't start without these either. other versions running on the
+  // same component find them in place
+  for (auto &file : runtime.files) {
+    if (file.download.url.isEmpty())
+      continue;
+
+    Download download{QUrl(file.download.url), runtimeDir + "/" + file.path,
+                      Priority::Critical, file.download.sha1,
+                      file.download.size};
+    downloadAsset(download);
+  }
+
+  // natives since 1.19 are on the classpath as well
+  QSet<QString> queued;
+  auto libraries = version.libraries;
+  for (auto &native : version.natives)
+    libraries << native.artifact;
+
+  for (auto lib : libraries) {
+    if (queued.contains(lib.path))
+      continue;
+
+    queued << lib.path;
+    auto urls = mirrored(libraryEndpoints, lib.path);
+    urls << QUrl(lib.url.isEmpty() ? LIBRARIES_ENDPOINT + lib.path : lib.url);
+    Download download{urls.takeFirst(), librariesDir + "/" + lib.path,
+                      Priority::Critical, lib.sha1, lib.size};
+    download.mirrors = urls;
+    downloadAsset(download);
+  }
+
+  createBuckets();
+  for (auto &obj : assets.objects) {
+    auto sha1 = obj.sha1();
+    auto hash = QString::fromLatin1(sha1.toHex());
+    auto entry = hash.left(2) + "/" + hash;
+    auto urls = mirrored(resourceEndpoints, entry);
+    Download download{urls.takeFirst(), assetsDir + "/objects/" + entry,
+                      obj.priority, sha1, obj.size};
+    download.mirrors = urls;
+
+    // only objects that predate the index get stat()ed here
+    if (!verifying && store.contains(sha1, obj.size)) {
+      indexed[sha1] = download;
+      metrics().cacheHits++;
+    } else if (!downloadAsset(download)) {
+      store.insert(sha1, QFileInfo(download.path));
+    }
+  }
+
+  store.save();
+
+  QFile index(assetsDir + "/indexes/" + version.assets + ".json");
+  QFileInfo(index).dir().mkpath(".");
+
+  index.open(QIODevice::WriteOnly);
+  index.write(assets.data);
+  index.close();
+}
+
+// objects only ever go into one of 256 buckets, so those are made once per
+// install instead of being checked for with every object
+void Launcher::createBuckets() {
+  auto objectsDir = assetsDir + "/objects";
+  bool created = QFileInfo::exists(objectsDir + "/.buckets");
+
+  for (int i = 0; i < 256; i++) {
+    auto bucket = QString("%1/%2").arg(objectsDir).arg(i, 2, 16, QChar('0'));
+    if (!created && !QDir().mkpath(bucket))
+      return;
+    directories().insert(bucket);
+  }
+
+  if (!created)
+    QFile(objectsDir + "/.buckets").open(QIODevice::WriteOnly);
+}
+
+bool Launcher::downloadAsset(const Download &download) {
+  if (haveAsset(download))
+    return false;
+
+  downloads->enqueue(download);
+  return true;
+}
+
+bool Launcher::haveAsset(const Download &download) {
+  // a size mismatch means an interrupted write, so fetch it again
+  QFileInfo info(download.path);
+  bool present =
+      info.exists() && (download.size < 0 || info.size() == download.size);
+  if (present && verifying && !intact(download)) {
+    qWarning() << download.path << "is corrupt, fetching it again";
+    store.remove(download.sha1);
+    QFile::remove(download.path);
+    present = false;
+  }
+
+  if (!present && !linkShared(download))
+    return false;
+
+  metrics().cacheHits++;
+  return true;
+}
+
+// consecutive snapshots share most of their jar, so with downloads/deltaClient
+// set a new one is patched together from the most recently installed ones
+bool Launcher::patchClient(const Download &download) {
+  if (!QSettings().value("downloads/deltaClient", false).toBool() ||
+      download.size <= 0 || download.sha1.isEmpty())
+    return false;
+
+  QFileInfoList jars;
+  QDir versions(dataDir.filePath("versions"));
+  for (auto &id : versions.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+    QFileInfo jar(versions.filePath(id + "/client.jar"));
+    if (id != version.id && jar.exists())
+      jars << jar;
+  }
+  if (jars.isEmpty())
+    return false;
+
+  std::sort(jars.begin(), jars.end(), [](auto &a, auto &b) {
+    return a.lastModified() > b.lastModified();
+  });
+  QStringList bases;
+  for (auto &jar : jars.mid(0, DELTA_CANDIDATES))
+    bases << jar.filePath();
+
+  patching = true;
+  auto patcher = new JarPatcher(download, bases, this);
+  patcher->done = [=](bool ok) {
+    patching = false;
+    if (!ok) {
+      downloads->enqueue(download);
+      return;
+    }
+
+    if (download.path == clientBlob && !materializeClient())
+      incomplete = true;
+    classpathReady();
+    if (!downloading())
+      downloadsSettled();
+  };
+  patcher->start();
+  return true;
+}
+
+bool Launcher::intact(const Download &download) {
+  QFile file(download.path);
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  if (download.sha1.isEmpty())
+    return true;
+
+  return file.open(QIODevice::ReadOnly) &&
+         hashFile(file, file.size(), hash) && hash.result() == download.sha1;
+}
+
+bool Launcher::linkShared(const Download &download) {
+  // laid out like our own data directory, and only ever holding files that
+  // were verified when they went in
+  if (sharedDir.isEmpty())
+    return false;
+
+  auto path = dataDir.relativeFilePath(download.path);
+  QFileInfo source(QDir(sharedDir).filePath(path));
+  if (path.startsWith("..") || !source.exists() ||
+      (download.size >= 0 && source.size() != download.size))
+    return false;
+
+  return linkFile(source.filePath(), download.path);
+}
+
+bool Launcher::materializeClient() {
+  auto jar = versionDir + "/client.jar";
+  if (!linkFile(clientBlob, jar)) {
+    qWarning() << "couldn't materialize" << jar;
+    return false;
+  }
+
+  return true;
+}
+
+// what the garbage collector goes by
+void Launcher::referenceClient() {
+  QDir(versionDir).mkpath(".");
+  QSaveFile ref(versionDir + "/client.sha1");
+  if (ref.open(QIODevice::WriteOnly)) {
+    ref.write(version.clientJar.sha1.toHex());
+    ref.commit();
+  }
+}
+
+void Launcher::downloadsSettled() {
+  classpathReady();
+  traceEnd("downloads", settledTrace, version.id);
+  settledTrace = -1;
+  installing().remove(this);
+  store.save();
+  dumpMetrics();
+  if (settled)
+    settled();
+
+  // a batch sweeps once everything in it has settled
+  if (!batched)
+    sweep();
+}
+
+// drops unreferenced objects if store/gc says so. only one sweep runs at a
+// time in the process, a second one would only race the first, and none
+// while another launcher is still fetching what it hasn't referenced yet.
+// moved assets may well be shared with other seats, whose indexes we can't
+// see, so those are never swept
+void Launcher::sweep(std::function<void()> callback) {
+  static bool sweeping = false;
+  bool moved = assetsDir != dataDir.filePath("assets");
+  if (sweeping || moved || !installing().isEmpty() ||
+      !QSettings().value("store/gc", false).toBool()) {
+    if (callback)
+      callback();
+    return;
+  }
+
+  sweeping = true;
+  auto versionsDir = dataDir.filePath("versions");
+  QThreadPool::globalInstance()->start([=]() {
+    auto removed = collectGarbage(assetsDir, versionsDir, storeDir);
+    QMetaObject::invokeMethod(
+        this,
+        [=]() {
+          for (auto &sha1 : removed)
+            store.remove(sha1);
+          store.save();
+
+          sweeping = false;
+          if (callback)
+            callback();
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+void Launcher::dumpMetrics() {
+  auto path = qEnvironmentVariable("AMETRINE_METRICS");
+  if (path.isEmpty())
+    return;
+
+  QSaveFile file(path);
+  if (file.open(QIODevice::WriteOnly)) {
+    file.write(QJsonDocument(metrics().toJson()).toJson());
+    file.commit();
+  }
+}
+
+void Launcher::rescanObjects() {
+  store.rescan(assetsDir + "/objects", this, [this](QVector<QByteArray> stale) {
+    for (auto sha1 : stale) {
+      store.remove(sha1);
+      if (indexed.contains(sha1))
+        downloads->enqueue(indexed.take(sha1));
+    }
+
+    qDebug() << stale.size() << "indexed objects were stale";
+    store.save();
+  });
+}
+
+// the manifest as a list view sees it. filtering only ever rewrites a vector
+// of row numbers, which keeps its capacity, and narrowing the search down
+// only looks at what's already showing
+class VersionListModel : public QAbstractListModel {
+public:
+  enum Type { Releases = 1, Snapshots = 2, Old = 4 };
+
+  using QAbstractListModel::QAbstractListModel;
+
+  void setManifest(const VersionManifest &manifest);
+  void setFilter(const QString &text, int types);
+  const VersionEntry *entry(const QModelIndex &index) const;
+  QModelIndex find(const QString &id) const;
+
+  int rowCount(const QModelIndex &parent = {}) const override;
+  QVariant data(const QModelIndex &index, int role) const override;
+
+private:
+  bool matches(const VersionEntry &entry) const;
+
+  QVector<VersionEntry> versions;
+  QVector<int> visible;
+  QString text;
+  int types = Releases;
+};
+
+void VersionListModel::setManifest(const VersionManifest &manifest) {
+  beginResetModel();
+  versions = manifest.versions;
+  visible.resize(0);
+  visible.reserve(versions.size());
+  for (int i = 0; i < versions.size(); i++)
+    if (matches(versions[i]))
+      visible << i;
+  endResetModel();
+}
+
+void VersionListModel::setFilter(const QString &text, int types) {
+  bool narrower = types == this->types && text.startsWith(this->text,
+                                                          Qt::CaseInsensitive);
+  this->text = text;
+  this->types = types;
+
+  beginResetModel();
+  if (narrower) {
+    visible.erase(std::remove_if(visible.begin(), visible.end(),
+                                 [this](int i) {
+                                   return !matches(versions[i]);
+                                 }),
+                  visible.end());
+  } else {
+    visible.resize(0);
+    for (int i = 0; i < versions.size(); i++)
+      if (matches(versions[i]))
+        visible << i;
+  }
+  endResetModel();
+}
+
+bool VersionListModel::matches(const VersionEntry &entry) const {
+  int type = entry.type == "release"    ? Releases
+             : entry.type == "snapshot" ? Snapshots
+                                        : Old;
+  return (types & type) && entry.id.contains(text, Qt::CaseInsensitive);
+}
+
+const VersionEntry *VersionListModel::entry(const QModelIndex &index) const {
+  if (!index.isValid() || index.row() >= visible.size())
+    return nullptr;
+  return &versions[visible[index.row()]];
+}
+
+QModelIndex VersionListModel::find(const QString &id) const {
+  for (int row = 0; row < visible.size(); row++)
+    if (versions[visible[row]].id == id)
+      return index(row);
+  return {};
+}
+
+int VersionListModel::rowCount(const QModelIndex &parent) const {
+  return parent.isValid() ? 0 : visible.size();
+}
+
+QVariant VersionListModel::data(const QModelIndex &index, int role) const {
+  auto version = entry(index);
+  if (!version)
+    return {};
+
+  if (role == Qt::DisplayRole)
+    return version->id;
+  if (role == Qt::ToolTipRole)
+    return QString("%1, released %2")
+        .arg(version->type)
+        .arg(QLocale().toString(version->releaseTime.date()));
+  return {};
+}
+
+class MainWindow : public QMainWindow {
+public:
+  explicit MainWindow();
+
+private:
+  void createVersionList();
+  void showProgress(Launcher *launcher, QProgressBar *progress,
+                    QLabel *status);
+  void showLog(GameProcess *game, QLabel *status);
+
+  QString selectedVersion() const;
+
+  VersionManager *manager;
+  VersionManifest manifest;
+  VersionListModel *versions;
+  QListView *list;
+  QPlainTextEdit *log;
+};
+
+MainWindow::MainWindow() { createVersionList(); }
+
+void MainWindow::createVersionList() {
+  manager = new VersionManager;
+  versions = new VersionListModel(this);
 
   auto widget = new QWidget;
   setCentralWidget(widget);
 
+  auto latest = new QLabel("Loading versions...");
+  auto search = new QLineEdit;
+  search->setPlaceholderText("Search versions");
+  search->setClearButtonEnabled(true);
+  auto snapshots = new QCheckBox("Snapshots");
+  auto old = new QCheckBox("Old versions");
+
+  // a few hundred rows of plain text, they're all the same height
+  list = new QListView;
+  list->setModel(versions);
+  list->setUniformItemSizes(true);
+
   auto launch = new QPushButton("Launch");
+  launch->setEnabled(false);
+
+  auto progress = new QProgressBar;
+  auto status = new QLabel;
+  progress->hide();
+
+  // holds as many lines as the game's buffer does, and no more
+  log = new QPlainTextEdit;
+  log->setReadOnly(true);
+  log->setMaximumBlockCount(LOG_LINES);
+  log->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+  log->hide();
+
+  auto filter = [=]() {
+    auto selected = selectedVersion();
+    int types = VersionListModel::Releases;
+    if (snapshots->isChecked())
+      types |= VersionListModel::Snapshots;
+    if (old->isChecked())
+      types |= VersionListModel::Old;
+
+    versions->setFilter(search->text(), types);
+    list->setCurrentIndex(versions->find(selected));
+  };
+  connect(search, &QLineEdit::textChanged, this, filter);
+  connect(snapshots, &QCheckBox::toggled, this, filter);
+  connect(old, &QCheckBox::toggled, this, filter);
+
+  // whatever gets picked is likely to be launched next. filtering puts the
+  // same one back after every keystroke, which needs nothing fetched
+  auto prefetched = QSharedPointer<QString>::create();
+  connect(list->selectionModel(), &QItemSelectionModel::currentChanged, this,
+          [=](const QModelIndex &current) {
+            auto entry = versions->entry(current);
+            if (!entry || entry->id == *prefetched)
+              return;
+
+            *prefetched = entry->id;
+            manager->prefetch(manifest, entry->id);
+          });
+
   connect(launch, &QPushButton::pressed, [=]() {
+    auto id = selectedVersion();
+    if (id.isEmpty())
+      id = manifest.latestRelease;
+
     setCursor(Qt::WaitCursor);
-    auto version = manager->fetchVersion(manifest, manifest.latestRelease);
-    auto assets = manager->fetchAssets(version);
-    unsetCursor();
+    manager->fetchVersion(manifest, id, [=](auto version) {
+      manager->fetchAssets(version, [=](auto assets) {
+        manager->fetchRuntime(version, [=](auto runtime) {
+          unsetCursor();
+
+          auto launcher = new Launcher(version, assets, runtime);
+          launcher->spawned = [=](GameProcess *game) { showLog(game, status); };
+          launcher->launchGame();
+          showProgress(launcher, progress, status);
+        });
+      });
+    });
+  });
+
+  // the window is up before the manifest arrives
+  manager->fetchManifest([=](auto manifest) {
+    this->manifest = manifest;
+    latest->setText("Latest: " + manifest.latestRelease);
+    launch->setEnabled(!manifest.latestRelease.isEmpty());
 
-    auto launcher = new Launcher(version, assets);
-    launcher->launchGame();
+    // a revalidated manifest shouldn't lose what was picked
+    auto selected = selectedVersion();
+    versions->setManifest(manifest);
+    list->setCurrentIndex(versions->find(
+        selected.isEmpty() ? manifest.latestRelease : selected));
+
+    // most likely what gets launched, so have it ready before the click
+    if (!manifest.latestRelease.isEmpty())
+      manager->prefetch(manifest, manifest.latestRelease);
   });
 
+  auto filters = new QHBoxLayout;
+  filters->addWidget(snapshots);
+  filters->addWidget(old);
+
   auto layout = new QVBoxLayout(widget);
-  layout->addWidget(new QLabel("Latest: " + manifest.latestRelease));
+  layout->addWidget(latest);
+  layout->addWidget(search);
+  layout->addLayout(filters);
+  layout->addWidget(list);
   layout->addWidget(launch);
+  layout->addWidget(progress);
+  layout->addWidget(status);
+  layout->addWidget(log, 1);
+}
+
+QString MainWindow::selectedVersion() const {
+  auto entry = versions->entry(list->currentIndex());
+  return entry ? entry->id : QString();
+}
+
+void MainWindow::showProgress(Launcher *launcher, QProgressBar *progress,
+                              QLabel *status) {
+  // polled rather than pushed, thousands of tiny objects finishing would
+  // otherwise mean thousands of repaints
+  auto timer = new QTimer(this);
+  auto update = [=]() {
+    auto &metrics = launcher->metrics();
+    auto total = qMax<qint64>(metrics.bytesExpected, 1);
+
+    // QProgressBar only takes ints, so go by permille
+    progress->setRange(0, 1000);
+    progress->setValue(metrics.bytesSettled * 1000 / total);
+    progress->setVisible(launcher->downloading());
+    auto rate = qint64(metrics.throughput());
+    status->setText(QString("%1/s, %2 in flight, %3 retries")
+                        .arg(QLocale().formattedDataSize(rate))
+                        .arg(metrics.inFlight)
+                        .arg(metrics.retries));
+
+    if (!launcher->downloading())
+      timer->deleteLater();
+  };
+
+  connect(timer, &QTimer::timeout, this, update);
+  timer->start(PROGRESS_INTERVAL_MS);
+  update();
+}
+
+void MainWindow::showLog(GameProcess *game, QLabel *status) {
+  log->clear();
+  log->show();
+
+  // everything since the last batch goes in at once, with a note if the game
+  // was faster than us and some of it is already gone
+  auto shown = QSharedPointer<qint64>::create(0);
+  game->logged = [=]() {
+    auto &buffer = game->log();
+    QStringList lines;
+    if (*shown < buffer.first())
+      lines << QString("... %1 lines skipped").arg(buffer.first() - *shown);
+    for (auto n = qMax(*shown, buffer.first()); n < buffer.end(); n++)
+      lines << buffer.at(n).toString();
+    *shown = buffer.end();
+
+    if (!lines.isEmpty())
+      log->appendPlainText(lines.join('\n'));
+  };
+
+  game->exited = [=, exited = game->exited](int code) {
+    if (code != 0 && !game->crashReport.isEmpty())
+      status->setText("Game crashed, report saved to " + game->crashReport);
+    else if (code != 0)
+      status->setText(QString("Game exited with code %1").arg(code));
+    if (exited)
+      exited(code);
+  };
+}
+
+// headless installs, for provisioning machines. every version gets its own
+// launcher, but all of them share one scheduler, so whatever they have in
+// common is only fetched once
+class Batch : QObject {
+public:
+  Batch();
+  void install(const QStringList &ids, bool repair);
+  void launch(const QString &id);
+
+  std::function<void(int)> done; // with the exit code
+
+private:
+  void resolve(const QStringList &ids,
+               std::function<void(QVector<Launcher *>)> callback);
+  void report();
+  bool busy() const;
+
+  VersionManager *manager;
+  DownloadScheduler *downloads;
+  QVector<Launcher *> launchers;
+  int unresolved = 0;
+  bool installing = false;
+  bool reported = false;
+};
+
+Batch::Batch() {
+  manager = new VersionManager;
+  downloads = new DownloadScheduler(this);
+}
+
+void Batch::resolve(const QStringList &ids,
+                    std::function<void(QVector<Launcher *>)> callback) {
+  // the stale manifest will do, the revalidated one only calls back again
+  auto fetched = QSharedPointer<bool>::create(false);
+  manager->fetchManifest([=](const VersionManifest &manifest) {
+    if (*fetched)
+      return;
+    *fetched = true;
+
+    auto left = QSharedPointer<int>::create(ids.size());
+    auto resolved = [=](Launcher *launcher) {
+      if (launcher)
+        launchers << launcher;
+      if (--*left == 0)
+        callback(launchers);
+    };
+
+    if (ids.isEmpty())
+      callback({});
+
+    for (auto id : ids) {
+      if (id == "latest" || id == "release")
+        id = manifest.latestRelease;
+      else if (id == "snapshot")
+        id = manifest.latestSnapshot;
+
+      manager->fetchVersion(manifest, id, [=](const VersionInfo &version) {
+        if (version.mainClass.isEmpty()) {
+          qWarning() << "couldn't fetch version" << id;
+          unresolved++;
+          resolved(nullptr);
+          return;
+        }
+
+        manager->fetchAssets(version, [=](const AssetIndex &assets) {
+          manager->fetchRuntime(version, [=](const JavaRuntime &runtime) {
+            resolved(new Launcher(version, assets, runtime, downloads));
+          });
+        });
+      });
+    }
+  });
+}
+
+void Batch::install(const QStringList &ids, bool repair) {
+  resolve(ids, [=](QVector<Launcher *> launchers) {
+    // launchers early in the batch may run out of work before the others
+    // have even queued theirs
+    installing = true;
+    for (auto launcher : launchers) {
+      launcher->settled = [this]() {
+        if (!installing && !busy())
+          report();
+      };
+
+      if (repair)
+        launcher->repair();
+      else
+        launcher->install();
+    }
+    installing = false;
+
+    if (!busy())
+      report();
+  });
+}
+
+void Batch::launch(const QString &id) {
+  resolve({id}, [=](QVector<Launcher *> launchers) {
+    if (launchers.isEmpty()) {
+      done(1);
+      return;
+    }
+
+    // the log goes to the terminal just as the game would have written it
+    launchers[0]->spawned = [=](GameProcess *game) {
+      game->echo = true;
+      game->exited = [=, exited = game->exited](int code) {
+        if (!game->crashReport.isEmpty())
+          printf("crash report saved to %s\n", qPrintable(game->crashReport));
+        exited(code);
+      };
+    };
+    launchers[0]->exited = done;
+    launchers[0]->launchGame();
+  });
+}
+
+// patched jars are fetched outside the scheduler, so it alone can't tell
+bool Batch::busy() const {
+  for (auto launcher : launchers)
+    if (launcher->downloading())
+      return true;
+  return false;
+}
+
+void Batch::report() {
+  if (reported)
+    return;
+  reported = true;
+
+  auto &metrics = downloads->metrics;
+  printf("%d versions, %d downloaded, %d already there, %d failed\n",
+         launchers.size(), metrics.completed, metrics.cacheHits,
+         metrics.failed + unresolved);
+  fflush(stdout);
+
+  // the store is shared, so one sweep covers every version in the batch
+  int code = metrics.failed + unresolved > 0 ? 1 : 0;
+  if (launchers.isEmpty())
+    done(code);
+  else
+    launchers[0]->sweep([=]() { done(code); });
+}
+
+int runBatch(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("ametrine");
+  QCoreApplication::setOrganizationDomain("rinici.de");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Installs and launches Minecraft.");
+  parser.addHelpOption();
+  parser.addPositionalArgument("command", "install, verify or launch");
+  parser.addPositionalArgument("versions",
+                               "Version ids, or latest, release or snapshot. "
+                               "verify goes through everything installed "
+                               "if none are given.",
+                               "[versions...]");
+  parser.process(app);
+
+  auto ids = parser.positionalArguments();
+  if (ids.isEmpty())
+    parser.showHelp(1);
+
+  auto command = ids.takeFirst();
+
+  if (command == "verify" && ids.isEmpty())
+    ids = QDir(getDataDirectory().filePath("versions"))
+              .entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+  if ((command == "install" && ids.isEmpty()) ||
+      (command == "launch" && ids.size() != 1) ||
+      (command != "install" && command != "verify" && command != "launch"))
+    parser.showHelp(1);
+
+  Batch batch;
+  batch.done = [&](int code) { app.exit(code); };
+  QTimer::singleShot(0, &app, [&]() {
+    if (command == "launch")
+      batch.launch(ids[0]);
+    else
+      batch.install(ids, command == "verify");
+  });
+
+  return app.exec();
 }
 
+#ifndef AMETRINE_BENCH
 int main(int argc, char *argv[]) {
+  // anything on the command line means there's no window
+  if (argc > 1)
+    return runBatch(argc, argv);
+
+  auto start = traceStart();
   QApplication app(argc, argv);
+  traceEnd("QApplication", start);
 
   QApplication::setApplicationName("ametrine");
   QApplication::setOrganizationDomain("rinici.de");
 
   MainWindow win;
   win.show();
+  traceEnd("startup", start);
 
   return app.exec();
 }
+#endif